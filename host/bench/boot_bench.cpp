@@ -0,0 +1,229 @@
+/**
+ * Reboots a device whose settable retained properties drive outputs, once
+ * without a last-value store and once with a FileValueStore, and times how
+ * long it takes until every output is back in its last state. Without the
+ * store the values arrive with the retained messages after connecting, with
+ * it they are loaded before the device connects. Afterwards the values are
+ * changed while the device is offline and it reboots against a broker that
+ * still holds the old ones, the stored values have to win. An enum and a
+ * color property check that stored values get their native value on load.
+ *
+ * Usage: homie_bench_boot [properties]
+ */
+#include <sched.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Device.hpp>
+#include <FileValueStore.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define BENCH_STORE_PATH "/tmp/homie_bench_boot.values"
+#define PROPS_PER_NODE 10
+#define BENCH_TIMEOUT_US 10000000
+
+typedef std::map<std::string, std::string> Broker;
+
+struct Boot {
+    AsyncMqttClient *client;
+    Device *device;
+    std::vector<Property *> properties;
+    Property *mode;
+    Property *color;
+    // Last value a callback applied, the state of the output
+    std::unique_ptr<std::atomic<long>[]> outputs;
+    std::atomic<bool> ready;
+};
+
+// Devices keep their tasks running, so they are never deleted
+static Boot &boot(const Broker &broker, int propertyCount) {
+    Boot &b = *new Boot();
+    b.client = new AsyncMqttClient();
+    for (auto const &retained : broker)
+        b.client->setRetained(retained.first.c_str(), retained.second.c_str());
+    b.device = new Device(*b.client, BENCH_DEVICE_ID);
+    b.device->setName("Benchmark Device");
+    b.outputs.reset(new std::atomic<long>[propertyCount]);
+    b.ready = false;
+
+    Node *node = nullptr;
+    for (int i = 0; i < propertyCount; i++) {
+        if (i % PROPS_PER_NODE == 0) {
+            std::string nodeId = "node" + std::to_string(i / PROPS_PER_NODE);
+            node = &b.device->addNode(nodeId.c_str(), nodeId.c_str(), "bench");
+        }
+        std::string propId = "prop" + std::to_string(i);
+        Property &p = node->addProperty(propId.c_str(), propId.c_str(), HOMIE_INT);
+        p.setSettable(true);
+        p.setDefaultValue("0");
+        b.outputs[i] = -1;
+        std::atomic<long> *output = &b.outputs[i];
+        p.setCallback([output](Property &property, const char *payload) {
+            *output = atol(payload);
+            return String(payload);
+        });
+        b.properties.push_back(&p);
+    }
+
+    Node &formats = b.device->addNode("formats", "formats", "bench");
+    b.mode = &formats.addProperty("mode", "mode", HOMIE_ENUM);
+    b.mode->setFormat("off,low,high");
+    b.mode->setSettable(true);
+    b.mode->setDefaultValue("off");
+    b.color = &formats.addProperty("color", "color", HOMIE_COLOR);
+    b.color->setFormat("rgb");
+    b.color->setSettable(true);
+    b.color->setDefaultValue("0,0,0");
+
+    b.device->onDeviceStateChanged([&b](HomieDeviceState state) {
+        b.ready = state == DSTATE_READY;
+    });
+    return b;
+}
+
+static void waitReady(Boot &b) {
+    uint64_t end = hostshim::wallMicros() + BENCH_TIMEOUT_US;
+    while (!b.ready && hostshim::wallMicros() < end)
+        sched_yield();
+}
+
+// Number of outputs in the state of value + i
+static int countOutputs(Boot &b, long value) {
+    int correct = 0;
+    for (size_t i = 0; i < b.properties.size(); i++)
+        correct += b.outputs[i] == value + (long)i;
+    return correct;
+}
+
+static uint64_t waitOutputs(Boot &b, long value) {
+    uint64_t start = hostshim::wallMicros();
+    while (countOutputs(b, value) != (int)b.properties.size() && hostshim::wallMicros() - start < BENCH_TIMEOUT_US)
+        sched_yield();
+    return hostshim::wallMicros() - start;
+}
+
+// Number of property values on the broker in the state of value + i
+static int countBroker(Boot &b, const Broker &broker, long value) {
+    int correct = 0;
+    char topic[HOMIE_MAX_TOPIC_LEN + 1];
+    for (size_t i = 0; i < b.properties.size(); i++) {
+        auto retained = broker.find(b.properties[i]->getTopic(topic));
+        correct += retained != broker.end() && atol(retained->second.c_str()) == value + (long)i;
+    }
+    return correct;
+}
+
+// Text and native value of the enum and the color property
+static std::string describeFormats(Boot &b) {
+    char buff[128];
+    HomieColor color = b.color->getValueAsColor();
+    snprintf(buff, sizeof(buff), "mode '%s' index %d, color '%s' %d,%d,%d", b.mode->getValue(),
+             b.mode->getEnumIndex(), b.color->getValue(), color.h, color.s, color.v);
+    return buff;
+}
+
+static void setValues(Boot &b, long value) {
+    for (size_t i = 0; i < b.properties.size(); i++)
+        b.properties[i]->setValue(std::to_string(value + i).c_str());
+}
+
+// Retained messages the device left on the broker
+static void collect(Boot &b, Broker &broker) {
+    for (auto const &record : b.client->records()) {
+        if (record.kind == AsyncMqttClient::RECORD_PUBLISH && record.retain)
+            broker[record.topic] = record.payload;
+    }
+}
+
+static size_t countValuePublishes(Boot &b) {
+    size_t publishes = 0;
+    char topic[HOMIE_MAX_TOPIC_LEN + 1];
+    for (auto const &record : b.client->records()) {
+        if (record.kind != AsyncMqttClient::RECORD_PUBLISH)
+            continue;
+        for (Property *p : b.properties)
+            publishes += record.topic == p->getTopic(topic);
+    }
+    return publishes;
+}
+
+int main(int argc, char **argv) {
+    int propertyCount = argc > 1 ? std::max(1, atoi(argv[1])) : 100;
+    MqttLogger::setLevel(ESP_LOG_NONE);
+    remove(BENCH_STORE_PATH);
+
+    // First session sets the values and leaves them on the broker and in the store
+    Broker broker;
+    {
+        Boot &b = boot(broker, propertyCount);
+        FileValueStore &store = *new FileValueStore(BENCH_STORE_PATH);
+        b.device->setLastValueStore(store);
+        b.client->connect();
+        waitReady(b);
+        setValues(b, 100);
+        b.mode->setValue("high");
+        b.color->setValue("255,128,0");
+        b.device->getLastValueCache().flush();
+        collect(b, broker);
+        LastValueCache &cache = b.device->getLastValueCache();
+        printf("Session with %d settable retained properties wrote %u records in %u commits\n", propertyCount,
+               cache.getWriteCount(), cache.getCommitCount());
+    }
+
+    printf("%-22s %14s %12s %12s %14s\n", "", "outputs [ms]", "correct", "ready [ms]", "value pubs");
+    {
+        Boot &b = boot(broker, propertyCount);
+        uint64_t start = hostshim::wallMicros();
+        b.client->connect();
+        uint64_t took = waitOutputs(b, 100);
+        waitReady(b);
+        uint64_t ready = hostshim::wallMicros() - start;
+        printf("%-22s %14.3f %12d %12.3f %14zu\n", "no store", took / 1000.0, countOutputs(b, 100), ready / 1000.0,
+               countValuePublishes(b));
+    }
+
+    Boot *previous;
+    {
+        Boot &b = boot(broker, propertyCount);
+        uint64_t start = hostshim::wallMicros();
+        FileValueStore &store = *new FileValueStore(BENCH_STORE_PATH);
+        b.device->setLastValueStore(store);
+        uint64_t took = hostshim::wallMicros() - start;
+        int correct = countOutputs(b, 100);
+        std::string loaded = describeFormats(b);
+        b.client->connect();
+        waitReady(b);
+        uint64_t ready = hostshim::wallMicros() - start;
+        printf("%-22s %14.3f %12d %12.3f %14zu\n", "store, before connect", took / 1000.0, correct, ready / 1000.0,
+               countValuePublishes(b));
+        printf("  loaded:   %s\n  restored: %s\n", loaded.c_str(), describeFormats(b).c_str());
+        previous = &b;
+    }
+
+    // Changed while offline, the broker keeps the old values
+    previous->client->disconnect();
+    setValues(*previous, 200);
+    previous->device->getLastValueCache().flush();
+    {
+        Boot &b = boot(broker, propertyCount);
+        uint64_t start = hostshim::wallMicros();
+        FileValueStore &store = *new FileValueStore(BENCH_STORE_PATH);
+        b.device->setLastValueStore(store);
+        uint64_t took = hostshim::wallMicros() - start;
+        b.client->connect();
+        waitReady(b);
+        uint64_t ready = hostshim::wallMicros() - start;
+        collect(b, broker);
+        printf("%-22s %14.3f %12d %12.3f %14zu\n", "store, changed offline", took / 1000.0, countOutputs(b, 200),
+               ready / 1000.0, countValuePublishes(b));
+        printf("Broker holds %d of %d values set offline\n", countBroker(b, broker, 200), propertyCount);
+    }
+    remove(BENCH_STORE_PATH);
+    return 0;
+}
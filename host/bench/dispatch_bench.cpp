@@ -0,0 +1,101 @@
+/**
+ * Times the topic -> Property lookup the incoming task does for every message,
+ * TopicIndex against the former std::map with strcmp ordering.
+ *
+ * Usage: homie_bench_dispatch [lookups]
+ */
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Device.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define PROPS_PER_NODE 10
+
+struct CmpStr {
+    bool operator()(char const *a, char const *b) const {
+        return strcmp(a, b) < 0;
+    }
+};
+
+#define BENCH_REPEATS 5
+
+// Best of BENCH_REPEATS runs, the others were disturbed by whatever else ran
+template <typename F>
+static double nsPerLookup(const std::vector<std::string> &topics, long lookups, F lookup) {
+    double best = 0;
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        size_t hits = 0;
+        uint64_t start = hostshim::wallMicros();
+        for (long i = 0; i < lookups; i++) {
+            if (lookup(topics[i % topics.size()].c_str()))
+                hits++;
+        }
+        uint64_t elapsed = hostshim::wallMicros() - start;
+        if (hits != (size_t)lookups)
+            printf("unexpected misses: %zu\n", lookups - hits);
+        double ns = elapsed * 1000.0 / lookups;
+        best = r == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+static void run(int propertyCount, long lookups) {
+    AsyncMqttClient client;
+    Device device(client, BENCH_DEVICE_ID);
+
+    std::vector<Node *> nodes;
+    std::vector<std::string> topics;
+    for (int i = 0; i < propertyCount; i++) {
+        if (i % PROPS_PER_NODE == 0) {
+            std::string nodeId = "light" + std::to_string(i / PROPS_PER_NODE);
+            nodes.push_back(&device.addNode(nodeId.c_str(), nodeId.c_str(), "bench"));
+        }
+        std::string propId = "channel" + std::to_string(i);
+        nodes.back()->addProperty(propId.c_str(), propId.c_str(), HOMIE_INT);
+
+        std::string topic = std::string("homie/" BENCH_DEVICE_ID "/") + nodes.back()->getId() + "/" + propId;
+        topics.push_back(topic);
+        topics.push_back(topic + "/set");
+    }
+    std::random_shuffle(topics.begin(), topics.end());
+
+    TopicIndex index;
+    index.build("homie/" BENCH_DEVICE_ID "/", nodes, device.getArena());
+    std::map<const char *, Property *, CmpStr> map;
+    size_t t = 0;
+    for (auto const &node : nodes) {
+        for (auto const &prop : node->getProperties()) {
+            index.add(*prop, TOPIC_DATA);
+            index.add(*prop, TOPIC_SET);
+        }
+    }
+    for (auto const &topic : topics) {
+        map[topic.c_str()] = nodes[t++ % nodes.size()]->getProperties()[0];
+    }
+
+    double mapNs = nsPerLookup(topics, lookups, [&map](const char *topic) {
+        return map.find(topic) != map.end();
+    });
+    double indexNs = nsPerLookup(topics, lookups, [&index](const char *topic) {
+        return index.find(topic) != nullptr;
+    });
+
+    printf("%10d %16.1f %16.1f\n", propertyCount, mapNs, indexNs);
+}
+
+int main(int argc, char **argv) {
+    long lookups = argc > 1 ? std::max(1L, atol(argv[1])) : 2000000;
+    const int sizes[] = {10, 100, 300, 1000};
+
+    printf("Topic lookup, %ld lookups per size\n", lookups);
+    printf("%10s %16s %16s\n", "properties", "std::map [ns]", "TopicIndex [ns]");
+    for (int size : sizes) {
+        run(size, lookups);
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * Feeds MQTT messages into a ready device the way the async_tcp task does and
+ * counts the heap calls made on that thread, the incoming task works the
+ * messages off concurrently. The second run sends large messages in parts.
+ *
+ * Usage: homie_bench_incoming [messages] [multipart messages]
+ */
+#include <stdio.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <Device.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define BENCH_PROPERTIES 100
+#define PROPS_PER_NODE 10
+#define BENCH_MULTIPART_LEN 1500
+#define BENCH_MULTIPART_PARTS 3
+
+static thread_local size_t t_heapCalls = 0;
+
+void *operator new(size_t size) {
+    t_heapCalls++;
+    void *p = malloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    if (p)
+        t_heapCalls++;
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    operator delete(p);
+}
+
+int main(int argc, char **argv) {
+    long messages = argc > 1 ? std::max(1L, atol(argv[1])) : 100000;
+    long multipartMessages = argc > 2 ? std::max(1L, atol(argv[2])) : 1000;
+
+    // Not destroyed on exit, the device tasks keep using them
+    AsyncMqttClient &client = *new AsyncMqttClient();
+    Device &device = *new Device(client, BENCH_DEVICE_ID);
+    device.setName("Benchmark Device");
+
+    std::vector<std::string> topics;
+    Node *node = nullptr;
+    for (int i = 0; i < BENCH_PROPERTIES; i++) {
+        if (i % PROPS_PER_NODE == 0) {
+            std::string nodeId = "node" + std::to_string(i / PROPS_PER_NODE);
+            node = &device.addNode(nodeId.c_str(), nodeId.c_str(), "bench");
+        }
+        std::string propId = "prop" + std::to_string(i);
+        Property &p = node->addProperty(propId.c_str(), propId.c_str(), HOMIE_INT);
+        p.setSettable(true);
+        p.setRetained(true);
+        topics.push_back(std::string("homie/" BENCH_DEVICE_ID "/") + node->getId() + "/" + propId + "/set");
+    }
+    Property &blob = device.addNode("config", "config", "bench").addProperty("blob", "blob", HOMIE_STRING);
+    blob.setSettable(true);
+    blob.setRetained(true);
+
+    std::atomic<bool> ready(false);
+    device.onDeviceStateChanged([&ready](HomieDeviceState state) {
+        if (state == DSTATE_READY)
+            ready = true;
+    });
+    client.setRecording(false);
+    client.connect();
+    while (!ready)
+        sched_yield();
+
+    // Mutable buffers like the ones AsyncMqttClient hands out
+    std::vector<std::vector<char>> topicBuffers;
+    for (auto const &topic : topics)
+        topicBuffers.push_back(std::vector<char>(topic.c_str(), topic.c_str() + topic.size() + 1));
+    char payloads[2][4] = {"17", "42"};
+
+    size_t heapCalls = t_heapCalls;
+    uint64_t start = hostshim::wallMicros();
+    for (long i = 0; i < messages; i++) {
+        char *payload = payloads[(i / topicBuffers.size()) % 2];
+        client.receive(topicBuffers[i % topicBuffers.size()].data(), payload, 2, 0, 2);
+    }
+    uint64_t elapsed = hostshim::wallMicros() - start;
+    heapCalls = t_heapCalls - heapCalls;
+
+    MessagePool &pool = device.getMessagePool();
+    while (pool.getInUse() > 0)
+        sched_yield();
+
+    printf("Incoming messages: %ld\n", messages);
+    printf("  callback time      %10.1f ns/msg\n", elapsed * 1000.0 / messages);
+    printf("  heap calls         %10zu\n", heapCalls);
+    printf("  slots              %10zu\n", pool.getSize());
+    printf("  max slots in use   %10u\n", pool.getMaxInUse());
+    printf("  dropped, no slot   %10u\n", pool.getExhaustedCount());
+    printf("  dropped, oversized %10u\n", pool.getOversizedCount());
+
+    char blobTopic[] = "homie/" BENCH_DEVICE_ID "/config/blob/set";
+    std::vector<char> blobPayloads[2] = {std::vector<char>(BENCH_MULTIPART_LEN, 'a'),
+                                         std::vector<char>(BENCH_MULTIPART_LEN, 'b')};
+    size_t partLen = (BENCH_MULTIPART_LEN + BENCH_MULTIPART_PARTS - 1) / BENCH_MULTIPART_PARTS;
+
+    heapCalls = t_heapCalls;
+    elapsed = 0;
+    for (long i = 0; i < multipartMessages; i++) {
+        // There is only one multipart buffer, wait until the last message was worked off
+        while (pool.getInUse() > 0)
+            sched_yield();
+
+        // A message that never completes, it gets discarded by the next first part
+        if (i == 0)
+            client.receive(blobTopic, blobPayloads[0].data(), partLen, 0, BENCH_MULTIPART_LEN);
+
+        char *payload = blobPayloads[i % 2].data();
+        start = hostshim::wallMicros();
+        for (size_t index = 0; index < BENCH_MULTIPART_LEN; index += partLen) {
+            size_t len = std::min(partLen, BENCH_MULTIPART_LEN - index);
+            client.receive(blobTopic, payload + index, len, index, BENCH_MULTIPART_LEN);
+        }
+        elapsed += hostshim::wallMicros() - start;
+    }
+    heapCalls = t_heapCalls - heapCalls;
+    while (pool.getInUse() > 0)
+        sched_yield();
+
+    printf("Multipart messages: %ld of %d bytes in %d parts\n", multipartMessages, BENCH_MULTIPART_LEN,
+           BENCH_MULTIPART_PARTS);
+    printf("  callback time      %10.1f ns/msg\n", elapsed * 1000.0 / multipartMessages);
+    printf("  heap calls         %10zu\n", heapCalls);
+    printf("  assembled          %10u\n", pool.getMultipartAssembledCount());
+    printf("  discarded          %10u\n", pool.getMultipartDiscardedCount());
+    printf("  blob length        %10zu\n", strlen(blob.getValue()));
+    return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * Sends set commands to one node with a slow callback (an I2C write, 30 ms)
+ * and to a few nodes with fast callbacks, and measures how long the commands
+ * of the fast nodes wait, with the callbacks run on the incoming task and on
+ * callback lanes.
+ *
+ * Usage: homie_bench_lanes [rounds]
+ */
+#include <sched.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <Device.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define BENCH_FAST_NODES 3
+#define BENCH_SLOW_CALLBACK_MS 30
+#define BENCH_MAX_MESSAGES 4096
+
+// Indexed by the payload, which starts at 1, a payload equal to the current value would be ignored as our own echo
+static uint64_t sentAt[BENCH_MAX_MESSAGES + 1];
+
+struct Latency {
+    // The defaults pass after connecting runs the callbacks as well, they arent measured
+    std::atomic<bool> measuring;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max;
+    std::atomic<long> count;
+};
+
+static void record(Latency &latency, const char *payload) {
+    if (!latency.measuring)
+        return;
+    uint64_t waited = hostshim::wallMicros() - sentAt[atoi(payload)];
+    latency.total += waited;
+    latency.count++;
+    uint64_t max = latency.max;
+    while (waited > max && !latency.max.compare_exchange_weak(max, waited)) {
+    }
+}
+
+static void run(const char *name, uint8_t lanes, bool slowNodeAlone, long rounds) {
+    // Devices keep their tasks running, so they are never deleted
+    AsyncMqttClient &client = *new AsyncMqttClient();
+    Device &device = *new Device(client, BENCH_DEVICE_ID);
+    device.setName("Benchmark Device");
+    device.setCallbackLanes(lanes);
+
+    Latency &fast = *new Latency();
+    Latency &slow = *new Latency();
+    std::vector<std::vector<char>> topics;
+    for (int i = 0; i <= BENCH_FAST_NODES; i++) {
+        std::string nodeId = "node" + std::to_string(i);
+        Node &node = device.addNode(nodeId.c_str(), nodeId.c_str(), "bench");
+        Property &p = node.addProperty("level", "level", HOMIE_INT);
+        p.setSettable(true);
+        bool isSlow = i == 0;
+        if (slowNodeAlone)
+            node.setCallbackLane(isSlow ? 0 : 1);
+        p.setCallback([isSlow, &fast, &slow](Property &property, const char *payload) {
+            if (isSlow)
+                vTaskDelay(pdMS_TO_TICKS(BENCH_SLOW_CALLBACK_MS));
+            record(isSlow ? slow : fast, payload);
+            return String(payload);
+        });
+        std::string topic = "homie/" BENCH_DEVICE_ID "/" + nodeId + "/level/set";
+        topics.push_back(std::vector<char>(topic.c_str(), topic.c_str() + topic.size() + 1));
+    }
+
+    std::atomic<bool> ready(false);
+    device.onDeviceStateChanged([&ready](HomieDeviceState state) {
+        if (state == DSTATE_READY)
+            ready = true;
+    });
+    client.setRecording(false);
+    client.connect();
+    while (!ready)
+        sched_yield();
+
+    fast.measuring = true;
+    slow.measuring = true;
+
+    // Every round the slow node gets one command, followed by one for each fast node
+    long messages = 0;
+    uint64_t start = hostshim::wallMicros();
+    for (long r = 0; r < rounds; r++) {
+        for (auto &topic : topics) {
+            char payload[12];
+            int len = snprintf(payload, sizeof(payload), "%ld", ++messages);
+            sentAt[messages] = hostshim::wallMicros();
+            client.receive(topic.data(), payload, len, 0, len);
+        }
+    }
+    while (fast.count + slow.count < messages)
+        sched_yield();
+    uint64_t elapsed = hostshim::wallMicros() - start;
+
+    uint32_t maxDepth = 0;
+    CallbackDispatcher &dispatcher = device.getCallbackDispatcher();
+    for (uint8_t lane = 0; lane < dispatcher.getLaneCount(); lane++)
+        maxDepth = std::max(maxDepth, dispatcher.getStats(lane).maxDepth);
+
+    printf("%-24s %10.1f %10.1f %10.1f %10u %10.1f\n", name, fast.total / 1000.0 / fast.count, fast.max / 1000.0,
+           slow.total / 1000.0 / slow.count, maxDepth, elapsed / 1000.0);
+}
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? std::max(1L, std::min(atol(argv[1]), (long)BENCH_MAX_MESSAGES / (BENCH_FAST_NODES + 1))) : 10;
+
+    printf("%ld rounds of one command to a node with a %d ms callback and one to each of %d fast nodes\n", rounds,
+           BENCH_SLOW_CALLBACK_MS, BENCH_FAST_NODES);
+    printf("%-24s %10s %10s %10s %10s %10s\n", "", "fast [ms]", "fast max", "slow [ms]", "max depth", "total [ms]");
+    run("incoming task", 0, false, rounds);
+    run("2 lanes, round robin", 2, false, rounds);
+    run("2 lanes, slow node alone", 2, true, rounds);
+    run("4 lanes", 4, false, rounds);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * Logs from several tasks at once, each task logs a burst of lines every
+ * 10 ms. Times the log() calls and counts what the logger task publishes to
+ * debug/<id>, the lines per publish and the lines that were dropped.
+ * Afterwards times log calls that are filtered out at compile time and at runtime.
+ *
+ * Usage: homie_bench_logger [lines per burst] [threads] [duration ms]
+ */
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <MqttLogger.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define BENCH_BURST_INTERVAL_MS 10
+
+int main(int argc, char **argv) {
+    int burst = argc > 1 ? std::max(1, atoi(argv[1])) : 1;
+    int threads = argc > 2 ? std::max(1, atoi(argv[2])) : 2;
+    long durationMs = argc > 3 ? std::max(1L, atol(argv[3])) : 1000;
+
+    // Not destroyed on exit, the logger task keeps using it
+    AsyncMqttClient &client = *new AsyncMqttClient();
+    client.setConnected(true);
+    MqttLogger::init(&client, BENCH_DEVICE_ID);
+
+    std::atomic<long> logged(0);
+    std::atomic<uint64_t> logMicros(0);
+    std::vector<std::thread> loggers;
+    for (int t = 0; t < threads; t++) {
+        loggers.push_back(std::thread([&, t] {
+            uint64_t end = hostshim::wallMicros() + durationMs * 1000;
+            long i = 0;
+            while (hostshim::wallMicros() < end) {
+                uint64_t start = hostshim::wallMicros();
+                for (int b = 0; b < burst; b++, i++)
+                    MqttLogger::log("Bench", "Property %s(%s) topic->'%s' payload->'%ld'", "Brightness", "brightness",
+                                    "homie/" BENCH_DEVICE_ID "/light/brightness", i + t);
+                logMicros += hostshim::wallMicros() - start;
+                logged += burst;
+                std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_BURST_INTERVAL_MS));
+            }
+        }));
+    }
+    for (auto &logger : loggers)
+        logger.join();
+
+    // Let the logger task drain the buffer
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * HOMIE_LOG_FLUSH_MS));
+
+    size_t publishes = 0;
+    size_t published = 0;
+    for (auto const &record : client.records()) {
+        if (record.kind != AsyncMqttClient::RECORD_PUBLISH)
+            continue;
+        publishes++;
+        published += std::count(record.payload.begin(), record.payload.end(), '\n') + 1;
+    }
+
+    printf("Logging from %d threads, %d lines every %d ms for %ld ms\n", threads, burst, BENCH_BURST_INTERVAL_MS,
+           durationMs);
+    printf("  lines logged       %10ld\n", logged.load());
+    printf("  log() call         %10.1f ns\n", logMicros * 1000.0 / logged);
+    printf("  publishes          %10zu\n", publishes);
+    printf("  lines published    %10zu (incl. drop reports)\n", published);
+    printf("  lines per publish  %10.1f\n", publishes ? (double)published / publishes : 0.0);
+    printf("  lines dropped      %10u\n", MqttLogger::getDroppedCount());
+
+    // log_v is above HOMIE_LOG_LEVEL_MQTT and HOMIE_LOG_LEVEL_SERIAL by default, log_i only filtered at runtime
+    const long calls = 1000000;
+    MqttLogger::setLevel(ESP_LOG_ERROR);
+    uint64_t start = hostshim::wallMicros();
+    for (long i = 0; i < calls; i++)
+        log_v("Property %s(%s) payload->'%ld'", "Brightness", "brightness", i);
+    uint64_t compiledOut = hostshim::wallMicros() - start;
+    start = hostshim::wallMicros();
+    for (long i = 0; i < calls; i++)
+        log_i("Property %s(%s) payload->'%ld'", "Brightness", "brightness", i);
+    uint64_t runtimeFiltered = hostshim::wallMicros() - start;
+
+    printf("Filtered log calls, runtime MQTT level error\n");
+    printf("  log_v compiled out %10.1f ns\n", compiledOut * 1000.0 / calls);
+    printf("  log_i at runtime   %10.1f ns\n", runtimeFiltered * 1000.0 / calls);
+    return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * Builds the same device of 10 nodes with 10 properties each once through
+ * addNode/addProperty and the setters, and once from HOMIE_DECLARE_NODE
+ * declarations. Counts the heap calls and bytes of building the model and
+ * of Device::setup() and times the setup. Reports the footprint of the
+ * model arena once the restore sealed it.
+ *
+ * Usage: homie_bench_model
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+#include <string>
+
+#include <Device.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define BENCH_NODES 10
+
+static thread_local size_t t_heapCalls = 0;
+static thread_local size_t t_heapBytes = 0;
+
+void *operator new(size_t size) {
+    t_heapCalls++;
+    t_heapBytes += size;
+    void *p = malloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    if (p)
+        t_heapCalls++;
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    operator delete(p);
+}
+
+#define BENCH_PROPERTIES(P, N)                                                  \
+    P(N, temperature, "Temperature", HOMIE_FLOAT, false, true, "°C", nullptr)   \
+    P(N, humidity, "Humidity", HOMIE_FLOAT, false, true, "%", "0:100")          \
+    P(N, power, "Power", HOMIE_BOOL, true, true, nullptr, nullptr)              \
+    P(N, brightness, "Brightness", HOMIE_INT, true, true, "%", "0:100")         \
+    P(N, mode, "Mode", HOMIE_ENUM, true, true, nullptr, "off,low,high")         \
+    P(N, color, "Color", HOMIE_COLOR, true, true, nullptr, "hsv")               \
+    P(N, label, "Label", HOMIE_STRING, true, true, nullptr, nullptr)            \
+    P(N, interval, "Interval", HOMIE_INT, true, true, "s", "1:3600")            \
+    P(N, voltage, "Voltage", HOMIE_FLOAT, false, true, "V", nullptr)            \
+    P(N, restart, "Restart", HOMIE_BOOL, true, false, nullptr, nullptr)
+
+HOMIE_DECLARE_NODE(node0, BENCH_DEVICE_ID, node0, "Node 0", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node1, BENCH_DEVICE_ID, node1, "Node 1", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node2, BENCH_DEVICE_ID, node2, "Node 2", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node3, BENCH_DEVICE_ID, node3, "Node 3", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node4, BENCH_DEVICE_ID, node4, "Node 4", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node5, BENCH_DEVICE_ID, node5, "Node 5", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node6, BENCH_DEVICE_ID, node6, "Node 6", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node7, BENCH_DEVICE_ID, node7, "Node 7", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node8, BENCH_DEVICE_ID, node8, "Node 8", "bench", BENCH_PROPERTIES);
+HOMIE_DECLARE_NODE(node9, BENCH_DEVICE_ID, node9, "Node 9", "bench", BENCH_PROPERTIES);
+
+static const HomieNodeSpec *declaredNodes[BENCH_NODES] = {&node0, &node1, &node2, &node3, &node4,
+                                                          &node5, &node6, &node7, &node8, &node9};
+
+// Same model as BENCH_PROPERTIES, built at runtime
+#define BENCH_RUNTIME_PROPERTY_(N, id, name, dataType, settable, retained, unit, format) \
+    {                                                                                   \
+        Property &p = node.addProperty(#id, name, dataType);                            \
+        p.setSettable(settable);                                                        \
+        p.setRetained(retained);                                                        \
+        if (unit)                                                                       \
+            p.setUnit(unit);                                                            \
+        if (format)                                                                     \
+            p.setFormat(format);                                                        \
+    }
+
+static void buildAtRuntime(Device &device) {
+    for (int i = 0; i < BENCH_NODES; i++) {
+        std::string nodeId = "node" + std::to_string(i);
+        std::string name = "Node " + std::to_string(i);
+        Node &node = device.addNode(nodeId.c_str(), name.c_str(), "bench");
+        BENCH_PROPERTIES(BENCH_RUNTIME_PROPERTY_, _)
+    }
+}
+
+static void buildDeclared(Device &device) {
+    for (int i = 0; i < BENCH_NODES; i++)
+        device.addNode(*declaredNodes[i]);
+}
+
+// Returns the footprint of the arena, reserve is the size of its first chunk as with HOMIE_MODEL_ARENA_SIZE
+static size_t run(const char *name, void (*build)(Device &), size_t reserve) {
+    AsyncMqttClient &client = *new AsyncMqttClient();
+    client.setRecording(false);
+    Device &device = *new Device(client, BENCH_DEVICE_ID);
+    if (reserve)
+        device.getArena().reserve(reserve);
+    device.setName("Benchmark Device");
+
+    size_t calls = t_heapCalls;
+    size_t bytes = t_heapBytes;
+    build(device);
+    size_t modelCalls = t_heapCalls - calls;
+    size_t modelBytes = t_heapBytes - bytes;
+
+    // Skip the connect callback, setup is driven directly
+    client.setConnected(true);
+    calls = t_heapCalls;
+    bytes = t_heapBytes;
+    uint64_t start = hostshim::wallMicros();
+    device.setup();
+    uint64_t took = hostshim::wallMicros() - start;
+    size_t setupCalls = t_heapCalls - calls;
+    size_t setupBytes = t_heapBytes - bytes;
+
+    // Nothing is retained on the broker, the restore applies the defaults and seals the arena
+    device.restoreRetainedProperties();
+    ModelArena &arena = device.getArena();
+
+    printf("%-10s %12zu %12zu %12zu %12zu %12.3f %12zu %12zu %8u\n", name, modelCalls, modelBytes, setupCalls,
+           setupBytes, took / 1000.0, arena.getBytes(), arena.getCapacity(), arena.getChunkCount());
+    return arena.getBytes();
+}
+
+int main(int argc, char **argv) {
+    // Keeps the heap counts free of log lines
+    MqttLogger::setLevel(ESP_LOG_NONE);
+
+    printf("Device with %d nodes of 10 properties, setup heap counts include the fake broker\n", BENCH_NODES);
+    printf("%-10s %12s %12s %12s %12s %12s %12s %12s %8s\n", "", "model heap", "model bytes", "setup heap",
+           "setup bytes", "setup [ms]", "arena bytes", "arena cap", "chunks");
+    size_t footprint = run("runtime", buildAtRuntime, 0);
+    run("declared", buildDeclared, 0);
+    run("reserved", buildAtRuntime, footprint);
+    return 0;
+}
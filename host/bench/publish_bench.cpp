@@ -0,0 +1,123 @@
+/**
+ * Sets property values from a tight control loop and counts what reaches the
+ * MQTT client, without limits, with a minimum publish interval per property
+ * and with a device wide publish rate limit on top. The sensor modes set
+ * values that rarely change, or only jitter, with and without change detection.
+ *
+ * Usage: homie_bench_publish [duration ms]
+ */
+#include <sched.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <Device.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define BENCH_PROPERTIES 10
+#define BENCH_INTERVAL_MS 100
+#define BENCH_RATE_LIMIT 50
+#define BENCH_HEARTBEAT_MS 1000
+
+struct Mode {
+    const char *name;
+    uint32_t interval;
+    uint16_t rateLimit;
+    bool skipUnchanged;
+    double deadband;
+    uint32_t heartbeat;
+    // Value of the n-th setValue call
+    int (*value)(long n);
+};
+
+static int counter(long n) {
+    return n % 1000;
+}
+
+// Changes every 100 calls per property
+static int slowSensor(long n) {
+    return n / (100 * BENCH_PROPERTIES);
+}
+
+// Jitters by one around a value that never changes
+static int noisySensor(long n) {
+    return 20 + (n / BENCH_PROPERTIES) % 3 - 1;
+}
+
+static void run(const Mode &mode, long durationMs) {
+    // Devices keep their tasks running, so they are never deleted
+    AsyncMqttClient &client = *new AsyncMqttClient();
+    Device &device = *new Device(client, BENCH_DEVICE_ID);
+    device.setName("Benchmark Device");
+
+    Node &node = device.addNode("sensors", "sensors", "bench");
+    std::vector<Property *> properties;
+    for (int i = 0; i < BENCH_PROPERTIES; i++) {
+        std::string propId = "value" + std::to_string(i);
+        Property &p = node.addProperty(propId.c_str(), propId.c_str(), HOMIE_INT);
+        p.setRetained(true);
+        p.setPublishInterval(mode.interval);
+        p.setSkipUnchanged(mode.skipUnchanged);
+        p.setDeadband(mode.deadband);
+        p.setHeartbeatInterval(mode.heartbeat);
+        properties.push_back(&p);
+    }
+    device.setPublishRateLimit(mode.rateLimit);
+
+    std::atomic<bool> ready(false);
+    device.onDeviceStateChanged([&ready](HomieDeviceState state) {
+        if (state == DSTATE_READY)
+            ready = true;
+    });
+    client.setRecording(false);
+    client.connect();
+    while (!ready)
+        sched_yield();
+
+    PublishScheduler &scheduler = device.getPublishScheduler();
+    uint32_t publishedBefore = scheduler.getPublishedCount();
+    uint32_t coalescedBefore = scheduler.getCoalescedCount();
+    uint32_t suppressedBefore = scheduler.getSuppressedCount();
+
+    long calls = 0;
+    uint64_t start = hostshim::wallMicros();
+    uint64_t end = start + durationMs * 1000;
+    uint64_t now = start;
+    while (now < end) {
+        for (int i = 0; i < 64; i++, calls++)
+            properties[calls % BENCH_PROPERTIES]->setValue(mode.value(calls));
+        now = hostshim::wallMicros();
+    }
+    uint64_t elapsed = now - start;
+
+    while (scheduler.getPendingCount() > 0)
+        sched_yield();
+
+    uint32_t published = scheduler.getPublishedCount() - publishedBefore;
+    printf("%-26s %12ld %12.1f %12u %12u %12u %12.1f\n", mode.name, calls, elapsed * 1000.0 / calls, published,
+           scheduler.getCoalescedCount() - coalescedBefore, scheduler.getSuppressedCount() - suppressedBefore,
+           published * 1000000.0 / elapsed);
+}
+
+int main(int argc, char **argv) {
+    long durationMs = argc > 1 ? std::max(1L, atol(argv[1])) : 3000;
+
+    printf("Control loop over %d properties for %ld ms\n", BENCH_PROPERTIES, durationMs);
+    printf("%-26s %12s %12s %12s %12s %12s %12s\n", "mode", "setValue", "ns/call", "published", "coalesced",
+           "suppressed", "publishes/s");
+    const Mode modes[] = {
+        {"unlimited", 0, 0, true, 0, 0, counter},
+        {"interval 100ms", BENCH_INTERVAL_MS, 0, true, 0, 0, counter},
+        {"interval + 50/s cap", BENCH_INTERVAL_MS, BENCH_RATE_LIMIT, true, 0, 0, counter},
+        {"slow sensor, every value", 0, 0, false, 0, 0, slowSensor},
+        {"slow sensor, on change", 0, 0, true, 0, 0, slowSensor},
+        {"noisy sensor, on change", 0, 0, true, 0, 0, noisySensor},
+        {"noisy, deadband 2", 0, 0, true, 2, 0, noisySensor},
+        {"noisy, deadband + 1s beat", 0, 0, true, 2, BENCH_HEARTBEAT_MS, noisySensor},
+    };
+    for (const Mode &mode : modes)
+        run(mode, durationMs);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * Drops and reestablishes the MQTT connection of a ready device, once with a
+ * clean session and once with a persistent session the broker kept, and
+ * times how long the device takes to be ready again. A last reconnect follows
+ * a disconnect during which every value changed, it counts how many of the
+ * values the broker ends up agreeing with the device on and how long that took.
+ * With the persistent session the device republishes them itself, with the
+ * clean session and no last value store the retained values are restored.
+ *
+ * Usage: homie_bench_reconnect [properties] [reconnects]
+ */
+#include <sched.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Device.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define PROPS_PER_NODE 10
+#define BENCH_TIMEOUT_US 10000000
+
+// Number of properties whose last published value is the one the device holds
+static int countAgreeing(AsyncMqttClient &client, const std::vector<Property *> &properties) {
+    std::map<std::string, std::string> last;
+    for (auto const &record : client.records()) {
+        if (record.kind == AsyncMqttClient::RECORD_PUBLISH)
+            last[record.topic] = record.payload;
+    }
+    int agreeing = 0;
+    char topic[HOMIE_MAX_TOPIC_LEN + 1];
+    for (Property *p : properties) {
+        auto published = last.find(p->getTopic(topic));
+        agreeing += published != last.end() && published->second == p->getValue();
+    }
+    return agreeing;
+}
+
+static void run(const char *name, bool persistent, int propertyCount, int reconnects) {
+    // Devices keep their tasks running, so they are never deleted
+    AsyncMqttClient &client = *new AsyncMqttClient();
+    Device &device = *new Device(client, BENCH_DEVICE_ID);
+    device.setName("Benchmark Device");
+    device.setPersistentSession(persistent);
+    std::vector<Property *> properties;
+
+    Node *node = nullptr;
+    for (int i = 0; i < propertyCount; i++) {
+        if (i % PROPS_PER_NODE == 0) {
+            std::string nodeId = "node" + std::to_string(i / PROPS_PER_NODE);
+            node = &device.addNode(nodeId.c_str(), nodeId.c_str(), "bench");
+        }
+        std::string propId = "prop" + std::to_string(i);
+        Property &p = node->addProperty(propId.c_str(), propId.c_str(), HOMIE_INT);
+        p.setSettable(true);
+        properties.push_back(&p);
+
+        // Value left on the broker by a previous session
+        std::string topic = std::string("homie/" BENCH_DEVICE_ID "/") + node->getId() + "/" + propId;
+        client.setRetained(topic.c_str(), "42");
+    }
+
+    std::atomic<bool> ready(false);
+    device.onDeviceStateChanged([&ready](HomieDeviceState state) {
+        ready = state == DSTATE_READY;
+    });
+    client.connect();
+    uint64_t settle = hostshim::wallMicros();
+    // The values held back until the device was ready are out before the first reconnect
+    while ((!ready || countAgreeing(client, properties) != propertyCount) &&
+           hostshim::wallMicros() - settle < BENCH_TIMEOUT_US)
+        sched_yield();
+
+    uint64_t total = 0;
+    uint64_t slowest = 0;
+    size_t subscribes = 0;
+    size_t publishes = 0;
+    for (int i = 0; i < reconnects; i++) {
+        client.disconnect();
+        client.clearRecords();
+
+        uint64_t start = hostshim::wallMicros();
+        client.connect();
+        while (!ready)
+            sched_yield();
+        uint64_t took = hostshim::wallMicros() - start;
+
+        total += took;
+        slowest = std::max(slowest, took);
+        subscribes += client.countRecords(AsyncMqttClient::RECORD_SUBSCRIBE);
+        publishes += client.countRecords(AsyncMqttClient::RECORD_PUBLISH);
+    }
+
+    // Changed while offline
+    client.disconnect();
+    for (Property *p : properties)
+        p->setValue("43");
+    client.clearRecords();
+    uint64_t start = hostshim::wallMicros();
+    client.connect();
+    int agreeing = countAgreeing(client, properties);
+    while ((!ready || agreeing != propertyCount) && hostshim::wallMicros() - start < BENCH_TIMEOUT_US) {
+        sched_yield();
+        agreeing = countAgreeing(client, properties);
+    }
+    uint64_t agreed = hostshim::wallMicros() - start;
+
+    printf("%-20s %12.3f %12.3f %12.1f %12.1f %12d %12.3f\n", name, total / 1000.0 / reconnects, slowest / 1000.0,
+           (double)subscribes / reconnects, (double)publishes / reconnects, agreeing, agreed / 1000.0);
+}
+
+int main(int argc, char **argv) {
+    int propertyCount = argc > 1 ? std::max(1, atoi(argv[1])) : 1000;
+    int reconnects = argc > 2 ? std::max(1, atoi(argv[2])) : 10;
+    // Keeps the publish counts free of log lines
+    MqttLogger::setLevel(ESP_LOG_NONE);
+
+    printf("%d reconnects of a device with %d settable retained properties\n", reconnects, propertyCount);
+    printf("%-20s %12s %12s %12s %12s %12s %12s\n", "", "ready [ms]", "max [ms]", "subscribes", "publishes",
+           "offline set", "agreed [ms]");
+    run("clean session", false, propertyCount, reconnects);
+    run("persistent session", true, propertyCount, reconnects);
+    return 0;
+}
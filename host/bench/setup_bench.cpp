@@ -0,0 +1,183 @@
+/**
+ * Times Device::setup() and Device::restoreRetainedProperties() for devices
+ * with 10, 100 and 1000 properties on the host, once for every subscribe mode.
+ *
+ * wall is the real time the phase took, delay is the part of it the
+ * library spent in vTaskDelay, heap the new/delete calls made by the phase.
+ *
+ * Usage: homie_bench_setup [repetitions]
+ */
+#include <stdio.h>
+
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <Device.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define PROPS_PER_NODE 10
+
+static thread_local size_t t_heapCalls = 0;
+
+void *operator new(size_t size) {
+    t_heapCalls++;
+    void *p = malloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    if (p)
+        t_heapCalls++;
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    operator delete(p);
+}
+
+struct PhaseResult {
+    double wallMs;
+    uint64_t delayedMs;
+    size_t heapCalls;
+    size_t publishes;
+    size_t subscribes;
+    size_t unsubscribes;
+};
+
+struct RunResult {
+    PhaseResult setup;
+    PhaseResult restore;
+};
+
+static const HomieDataType benchTypes[] = {HOMIE_INT, HOMIE_FLOAT, HOMIE_BOOL, HOMIE_STRING, HOMIE_ENUM, HOMIE_COLOR};
+
+static const char *retainedValueFor(HomieDataType type) {
+    switch (type) {
+        case HOMIE_INT:
+            return "42";
+        case HOMIE_FLOAT:
+            return "21.5";
+        case HOMIE_BOOL:
+            return "true";
+        case HOMIE_ENUM:
+            return "high";
+        case HOMIE_COLOR:
+            return "120,50,75";
+        default:
+            return "retained text";
+    }
+}
+
+static void buildDevice(Device &device, AsyncMqttClient &client, int propertyCount) {
+    device.setName("Benchmark Device");
+
+    Node *node = nullptr;
+    for (int i = 0; i < propertyCount; i++) {
+        if (i % PROPS_PER_NODE == 0) {
+            std::string nodeId = "node" + std::to_string(i / PROPS_PER_NODE);
+            node = &device.addNode(nodeId.c_str(), nodeId.c_str(), "bench");
+        }
+        HomieDataType type = benchTypes[i % (sizeof(benchTypes) / sizeof(benchTypes[0]))];
+        std::string propId = "prop" + std::to_string(i);
+        Property &p = node->addProperty(propId.c_str(), propId.c_str(), type);
+
+        p.setRetained(true);
+        p.setSettable(i % 2 == 0);
+        if (type == HOMIE_INT)
+            p.setFormat("0:100");
+        else if (type == HOMIE_ENUM)
+            p.setFormat("off,low,high");
+        else if (type == HOMIE_COLOR)
+            p.setFormat("hsv");
+
+        if (p.isSettable()) {
+            p.setCallback([](Property &property, const char *payload) {
+                return String(payload);
+            });
+        }
+
+        // Value left on the broker by a previous session
+        std::string topic = std::string("homie/" BENCH_DEVICE_ID "/") + node->getId() + "/" + propId;
+        client.setRetained(topic.c_str(), retainedValueFor(type));
+    }
+}
+
+static PhaseResult measure(AsyncMqttClient &client, std::function<void()> phase) {
+    client.clearRecords();
+    uint64_t delayed = hostshim::delayedMillis();
+    size_t heapCalls = t_heapCalls;
+    uint64_t wall = hostshim::wallMicros();
+
+    phase();
+
+    PhaseResult result;
+    result.heapCalls = t_heapCalls - heapCalls;
+    result.wallMs = (hostshim::wallMicros() - wall) / 1000.0;
+    result.delayedMs = hostshim::delayedMillis() - delayed;
+    result.publishes = client.countRecords(AsyncMqttClient::RECORD_PUBLISH);
+    result.subscribes = client.countRecords(AsyncMqttClient::RECORD_SUBSCRIBE);
+    result.unsubscribes = client.countRecords(AsyncMqttClient::RECORD_UNSUBSCRIBE);
+    return result;
+}
+
+static RunResult runOnce(int propertyCount, HomieSubscribeMode mode) {
+    AsyncMqttClient *client = new AsyncMqttClient();
+    Device *device = new Device(*client, BENCH_DEVICE_ID);
+    device->setSubscribeMode(mode);
+    buildDevice(*device, *client, propertyCount);
+
+    // Skip the connect callback, the phases are driven directly
+    client->setConnected(true);
+
+    RunResult result;
+    result.setup = measure(*client, [device] { device->setup(); });
+    result.restore = measure(*client, [device] { device->restoreRetainedProperties(); });
+
+    // The device tasks stay parked, the MQTT sink of the logger is off, so the device can go away.
+    delete device;
+    delete client;
+    return result;
+}
+
+static PhaseResult median(std::vector<PhaseResult> results) {
+    std::sort(results.begin(), results.end(), [](const PhaseResult &a, const PhaseResult &b) {
+        return a.wallMs < b.wallMs;
+    });
+    return results[results.size() / 2];
+}
+
+static void printRow(int propertyCount, const char *mode, const char *phase, const PhaseResult &r) {
+    printf("%10d  %-9s %-8s %12.3f %12llu %10zu %10zu %10zu %12zu\n", propertyCount, mode, phase, r.wallMs,
+           (unsigned long long)r.delayedMs, r.heapCalls, r.publishes, r.subscribes, r.unsubscribes);
+}
+
+int main(int argc, char **argv) {
+    int repetitions = argc > 1 ? std::max(1, atoi(argv[1])) : 5;
+    // Keeps the publish counts free of log lines
+    MqttLogger::setLevel(ESP_LOG_NONE);
+    const int sizes[] = {10, 100, 1000};
+    const HomieSubscribeMode modes[] = {SUBSCRIBE_PER_TOPIC, SUBSCRIBE_PER_NODE, SUBSCRIBE_WILDCARD};
+    const char *modeNames[] = {"topic", "node", "wildcard"};
+
+    printf("Homie device bring-up on host, median of %d runs\n", repetitions);
+    printf("%10s  %-9s %-8s %12s %12s %10s %10s %10s %12s\n", "properties", "subscribe", "phase", "wall [ms]",
+           "delay [ms]", "heap", "publishes", "subscribes", "unsubscribes");
+
+    for (int size : sizes) {
+        for (HomieSubscribeMode mode : modes) {
+            std::vector<PhaseResult> setups, restores;
+            for (int i = 0; i < repetitions; i++) {
+                RunResult r = runOnce(size, mode);
+                setups.push_back(r.setup);
+                restores.push_back(r.restore);
+            }
+            printRow(size, modeNames[mode], "setup", median(setups));
+            printRow(size, modeNames[mode], "restore", median(restores));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * Times what a control loop does with a property value, reading it back as a
+ * number and setting a new one, once through the text form like before and
+ * once through the typed getters and setters. Afterwards times checking
+ * payloads against a compiled $format against strtod/sscanf based checks.
+ * Finally several threads set and read properties of their own at the same time.
+ *
+ * Usage: homie_bench_value [iterations]
+ */
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Device.hpp>
+
+#define BENCH_DEVICE_ID "bench-device"
+#define BENCH_INTERVAL_MS 100
+#define BENCH_THREADS 4
+
+template <typename F>
+static double nsPerIteration(long iterations, F step) {
+    uint64_t start = hostshim::wallMicros();
+    for (long i = 0; i < iterations; i++)
+        step(i);
+    return (hostshim::wallMicros() - start) * 1000.0 / iterations;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? std::max(1L, atol(argv[1])) : 1000000;
+
+    // The publish task keeps running, so the device is never deleted
+    AsyncMqttClient &client = *new AsyncMqttClient();
+    Device &device = *new Device(client, BENCH_DEVICE_ID);
+    Node &node = device.addNode("pid", "pid", "bench");
+    Property &output = node.addProperty("output", "output", HOMIE_INT);
+    Property &setpoint = node.addProperty("setpoint", "setpoint", HOMIE_FLOAT);
+    // Values are coalesced, only a few of them get formatted for a publish
+    output.setPublishInterval(BENCH_INTERVAL_MS);
+    setpoint.setPublishInterval(BENCH_INTERVAL_MS);
+    setpoint.setValue("21.5");
+
+    volatile long sink = 0;
+    double readText = nsPerIteration(iterations, [&](long) { sink += atoi(output.getValue()); });
+    double readTyped = nsPerIteration(iterations, [&](long) { sink += output.getValueAsInt(); });
+    double readFloatText = nsPerIteration(iterations, [&](long) { sink += (long)atof(setpoint.getValue()); });
+    double readFloatTyped = nsPerIteration(iterations, [&](long) { sink += (long)setpoint.getValueAsDouble(); });
+    double setText = nsPerIteration(iterations, [&](long i) { output.setValue(String((int)(i % 1000))); });
+    double setTyped = nsPerIteration(iterations, [&](long i) { output.setValue((int)(i % 1000)); });
+    double loopTyped = nsPerIteration(iterations, [&](long i) {
+        double error = setpoint.getValueAsDouble() - output.getValueAsInt();
+        output.setValue((int)(output.getValueAsInt() + error / 2 + i % 3));
+    });
+
+    printf("Property value access, %ld iterations\n", iterations);
+    printf("%-26s %12s %12s\n", "", "text [ns]", "typed [ns]");
+    printf("%-26s %12.1f %12.1f\n", "integer read", readText, readTyped);
+    printf("%-26s %12.1f %12.1f\n", "float read", readFloatText, readFloatTyped);
+    printf("%-26s %12.1f %12.1f\n", "integer set", setText, setTyped);
+    printf("%-26s %12s %12.1f\n", "read, read, set", "", loopTyped);
+
+    ValueValidator range;
+    range.compile(HOMIE_FLOAT, "-40:125:0.5");
+    ValueValidator hsv;
+    hsv.compile(HOMIE_COLOR, "hsv");
+    const char *temperatures[] = {"21.5", "-3", "118.5", "0.5"};
+    const char *colors[] = {"120,100,50", "359,20,100", "0,0,0", "42.4,99.6,7"};
+    HomieValue native;
+    double checkScanf = nsPerIteration(iterations, [&](long i) {
+        char *end;
+        double value = strtod(temperatures[i % 4], &end);
+        sink += *end == '\0' && value >= -40 && value <= 125;
+    });
+    double checkRange = nsPerIteration(iterations, [&](long i) { sink += range.check(temperatures[i % 4], native); });
+    double colorScanf = nsPerIteration(iterations, [&](long i) {
+        float h, s, v;
+        sink += sscanf(colors[i % 4], "%a,%a,%a", &h, &s, &v) == 3 && h >= 0 && s >= 0 && v >= 0;
+    });
+    double colorCheck = nsPerIteration(iterations, [&](long i) { sink += hsv.check(colors[i % 4], native); });
+    char text[HOMIE_COLOR_TEXT_LEN];
+    double colorSprintf = nsPerIteration(iterations, [&](long i) {
+        sink += sprintf(text, "%.0f,%.0f,%.0f", (float)(i % 360), 100.0f, (float)(i % 100));
+    });
+    double colorFormat = nsPerIteration(iterations, [&](long i) {
+        HomieColor color = {(uint16_t)(i % 360), 100, (uint16_t)(i % 100)};
+        sink += ColorCodec::format(text, color);
+    });
+
+    printf("%-26s %12s %12s\n", "", "libc [ns]", "compiled [ns]");
+    printf("%-26s %12.1f %12.1f\n", "float in range", checkScanf, checkRange);
+    printf("%-26s %12.1f %12.1f\n", "hsv color", colorScanf, colorCheck);
+    printf("%-26s %12.1f %12.1f\n", "hsv color format", colorSprintf, colorFormat);
+
+    // Every thread runs the loop above on properties of its own, they only share the device
+    std::vector<Property *> outputs;
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        std::string id = "output" + std::to_string(t);
+        Property &p = node.addProperty(id.c_str(), id.c_str(), HOMIE_INT);
+        p.setPublishInterval(BENCH_INTERVAL_MS);
+        outputs.push_back(&p);
+    }
+    // Time per set of all threads together, with a lock shared by the threads it grows with their number
+    printf("%-26s %12s %12s\n", "", "threads", "typed [ns]");
+    for (int threads = 1; threads <= BENCH_THREADS; threads *= 2) {
+        std::vector<std::thread> loops;
+        uint64_t start = hostshim::wallMicros();
+        for (int t = 0; t < threads; t++) {
+            loops.push_back(std::thread([&, t] {
+                Property &out = *outputs[t];
+                for (long i = 0; i < iterations; i++) {
+                    double error = setpoint.getValueAsDouble() - out.getValueAsInt();
+                    out.setValue((int)(out.getValueAsInt() + error / 2 + i % 3));
+                }
+            }));
+        }
+        for (auto &loop : loops)
+            loop.join();
+        double took = (hostshim::wallMicros() - start) * 1000.0 / iterations / threads;
+        printf("%-26s %12d %12.1f\n", "read, read, set", threads, took);
+    }
+    return 0;
+}
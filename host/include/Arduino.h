@@ -0,0 +1,50 @@
+#pragma once
+
+/**
+ * Host shim for the parts of the ESP32 Arduino core used by the library.
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+#include <IPAddress.h>
+#include <WString.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
+
+using std::max;
+using std::min;
+
+/**
+ * @brief Milliseconds since process start.
+ */
+unsigned long millis();
+
+/**
+ * @brief Microseconds since process start.
+ */
+unsigned long micros();
+
+void delay(uint32_t ms);
+
+long random(long max);
+long random(long min, long max);
+
+// Same as esp32-hal-log.h, MqttLogger.hpp redefines these.
+#define log_e(format, ...) esp_log_write(ESP_LOG_ERROR, "", format, ##__VA_ARGS__)
+#define log_w(format, ...) esp_log_write(ESP_LOG_WARN, "", format, ##__VA_ARGS__)
+#define log_i(format, ...) esp_log_write(ESP_LOG_INFO, "", format, ##__VA_ARGS__)
+#define log_d(format, ...) esp_log_write(ESP_LOG_DEBUG, "", format, ##__VA_ARGS__)
+#define log_v(format, ...) esp_log_write(ESP_LOG_VERBOSE, "", format, ##__VA_ARGS__)
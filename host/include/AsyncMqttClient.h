@@ -0,0 +1,170 @@
+#pragma once
+
+/**
+ * Recording fake of AsyncMqttClient for host builds.
+ *
+ * Every publish/subscribe/unsubscribe is recorded. The client also acts as a
+ * tiny in-process broker: retained publishes are stored, subscribing delivers
+ * matching retained messages and publishes are echoed to matching
+ * subscriptions, just like a real broker would. Without clean session the
+ * subscriptions are kept across reconnects and reported as session present. Messages are delivered
+ * synchronously on the calling thread, outside of the client's lock.
+ */
+
+#include <Arduino.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class AsyncMqttClientDisconnectReason : int8_t {
+    TCP_DISCONNECTED = 0,
+
+    MQTT_UNACCEPTABLE_PROTOCOL_VERSION = 1,
+    MQTT_IDENTIFIER_REJECTED = 2,
+    MQTT_SERVER_UNAVAILABLE = 3,
+    MQTT_MALFORMED_CREDENTIALS = 4,
+    MQTT_NOT_AUTHORIZED = 5,
+
+    ESP8266_NOT_ENOUGH_SPACE = 6,
+
+    TLS_BAD_FINGERPRINT = 7
+};
+
+struct AsyncMqttClientMessageProperties {
+    uint8_t qos;
+    bool dup;
+    bool retain;
+};
+
+typedef std::function<void(bool sessionPresent)> OnConnectUserCallback;
+typedef std::function<void(AsyncMqttClientDisconnectReason reason)> OnDisconnectUserCallback;
+typedef std::function<void(char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t len,
+                           size_t index, size_t total)>
+    OnMessageUserCallback;
+
+class AsyncMqttClient {
+   public:
+    enum RecordKind {
+        RECORD_PUBLISH,
+        RECORD_SUBSCRIBE,
+        RECORD_UNSUBSCRIBE
+    };
+
+    struct Record {
+        RecordKind kind;
+        std::string topic;
+        std::string payload;
+        uint8_t qos;
+        bool retain;
+    };
+
+   private:
+    struct Delivery {
+        std::string topic;
+        std::string payload;
+        AsyncMqttClientMessageProperties props;
+    };
+
+    mutable std::mutex _lock;
+    bool _connected = false;
+    bool _recording = true;
+    bool _cleanSession = true;
+    // Set once a connection without clean session was made, the next one finds the session present
+    bool _sessionStored = false;
+    uint16_t _packetId = 0;
+    size_t _chunkSize = 0;
+
+    std::vector<Record> _records;
+    std::map<std::string, std::string> _retained;
+    std::map<std::string, uint8_t> _subscriptions;
+    // Filters containing + or #, exact filters are looked up directly
+    std::map<std::string, uint8_t> _wildcardSubscriptions;
+
+    std::vector<OnConnectUserCallback> _onConnect;
+    std::vector<OnDisconnectUserCallback> _onDisconnect;
+    std::vector<OnMessageUserCallback> _onMessage;
+
+    uint16_t nextPacketId();
+    void collectSubscribers(const std::string &topic, const std::string &payload, bool retain,
+                            std::vector<Delivery> &out);
+    void deliver(const std::vector<Delivery> &deliveries);
+    static bool isWildcard(const char *filter);
+
+   public:
+    AsyncMqttClient() {}
+
+    AsyncMqttClient &setKeepAlive(uint16_t keepAlive) {
+        return *this;
+    }
+    AsyncMqttClient &setClientId(const char *clientId) {
+        return *this;
+    }
+    AsyncMqttClient &setCleanSession(bool cleanSession);
+    AsyncMqttClient &setCredentials(const char *username, const char *password = nullptr) {
+        return *this;
+    }
+    AsyncMqttClient &setServer(IPAddress ip, uint16_t port) {
+        return *this;
+    }
+    AsyncMqttClient &setServer(const char *host, uint16_t port) {
+        return *this;
+    }
+    AsyncMqttClient &setWill(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr,
+                             size_t length = 0);
+
+    AsyncMqttClient &onConnect(OnConnectUserCallback callback);
+    AsyncMqttClient &onDisconnect(OnDisconnectUserCallback callback);
+    AsyncMqttClient &onMessage(OnMessageUserCallback callback);
+
+    bool connected() const;
+    void connect();
+    void disconnect(bool force = false);
+
+    uint16_t subscribe(const char *topic, uint8_t qos);
+    uint16_t unsubscribe(const char *topic);
+    uint16_t publish(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr, size_t length = 0,
+                     bool dup = false, uint16_t message_id = 0);
+
+    // --- Host only helpers ---
+
+    /**
+     * @brief Marks the client as connected/disconnected without running any callbacks.
+     */
+    void setConnected(bool connected);
+
+    /**
+     * @brief Stores a retained message on the fake broker, like a previous session would have.
+     */
+    void setRetained(const char *topic, const char *payload);
+
+    /**
+     * @brief Delivers a message from "another client" to all matching subscriptions.
+     */
+    void inject(const char *topic, const char *payload, bool retain = false);
+
+    /**
+     * @brief Hands the buffers straight to the onMessage callbacks, the way the async_tcp
+     * task does. No subscription matching and no copies, so it doesnt allocate.
+     */
+    void receive(char *topic, char *payload, size_t len, size_t index, size_t total, bool retain = false);
+
+    /**
+     * @brief Delivers payloads larger than chunkSize in several parts, the way
+     * AsyncMqttClient does when a message spans multiple TCP packets. 0 disables it.
+     */
+    void setPayloadChunkSize(size_t chunkSize);
+
+    void setRecording(bool recording);
+    void clearRecords();
+    std::vector<Record> records() const;
+    size_t countRecords(RecordKind kind) const;
+    size_t subscriptionCount() const;
+
+    /**
+     * @brief MQTT topic filter matching, supports the + and # wildcards.
+     */
+    static bool topicMatches(const char *filter, const char *topic);
+};
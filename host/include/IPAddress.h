@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <WString.h>
+
+class IPAddress {
+   private:
+    uint8_t _address[4];
+
+   public:
+    IPAddress() : _address{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _address{a, b, c, d} {}
+
+    uint8_t operator[](int index) const {
+        return _address[index];
+    }
+
+    String toString() const {
+        char buff[16];
+        snprintf(buff, sizeof(buff), "%u.%u.%u.%u", _address[0], _address[1], _address[2], _address[3]);
+        return String(buff);
+    }
+};
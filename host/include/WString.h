@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+/**
+ * Host version of the Arduino String, backed by std::string.
+ * Only the members used by the library and its examples are provided.
+ */
+class String {
+   private:
+    std::string _buffer;
+
+   public:
+    String(const char *cstr = "") : _buffer(cstr ? cstr : "") {}
+    String(const String &str) = default;
+    String(char c) : _buffer(1, c) {}
+    explicit String(int value, unsigned char base = 10) : _buffer(format(base == 16 ? "%x" : "%d", value)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : _buffer(format(base == 16 ? "%x" : "%u", value)) {}
+    explicit String(long value) : _buffer(format("%ld", value)) {}
+    explicit String(unsigned long value) : _buffer(format("%lu", value)) {}
+    explicit String(float value, unsigned char decimalPlaces = 2) : _buffer(formatFloat(value, decimalPlaces)) {}
+    explicit String(double value, unsigned char decimalPlaces = 2) : _buffer(formatFloat(value, decimalPlaces)) {}
+
+    String &operator=(const String &rhs) = default;
+
+    unsigned char reserve(unsigned int size) {
+        _buffer.reserve(size);
+        return 1;
+    }
+
+    unsigned int length() const {
+        return _buffer.length();
+    }
+
+    const char *c_str() const {
+        return _buffer.c_str();
+    }
+
+    unsigned char concat(const char *cstr) {
+        if (!cstr)
+            return 0;
+        _buffer.append(cstr);
+        return 1;
+    }
+
+    unsigned char concat(const String &str) {
+        _buffer.append(str._buffer);
+        return 1;
+    }
+
+    unsigned char concat(char c) {
+        _buffer.push_back(c);
+        return 1;
+    }
+
+    String &operator+=(const char *cstr) {
+        concat(cstr);
+        return *this;
+    }
+
+    String &operator+=(const String &str) {
+        concat(str);
+        return *this;
+    }
+
+    void remove(unsigned int index) {
+        if (index < _buffer.length())
+            _buffer.erase(index);
+    }
+
+    void remove(unsigned int index, unsigned int count) {
+        if (index < _buffer.length())
+            _buffer.erase(index, count);
+    }
+
+    bool equals(const char *cstr) const {
+        return _buffer == (cstr ? cstr : "");
+    }
+
+    bool operator==(const char *cstr) const {
+        return equals(cstr);
+    }
+
+    bool operator==(const String &rhs) const {
+        return _buffer == rhs._buffer;
+    }
+
+    long toInt() const {
+        return atol(_buffer.c_str());
+    }
+
+    float toFloat() const {
+        return (float)atof(_buffer.c_str());
+    }
+
+   private:
+    template <typename T>
+    static std::string format(const char *fmt, T value) {
+        char buff[24];
+        snprintf(buff, sizeof(buff), fmt, value);
+        return buff;
+    }
+
+    static std::string formatFloat(double value, unsigned char decimalPlaces) {
+        char buff[48];
+        snprintf(buff, sizeof(buff), "%.*f", decimalPlaces, value);
+        return buff;
+    }
+};
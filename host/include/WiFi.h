@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+typedef enum {
+    SYSTEM_EVENT_WIFI_READY = 0,
+    SYSTEM_EVENT_SCAN_DONE,
+    SYSTEM_EVENT_STA_START,
+    SYSTEM_EVENT_STA_STOP,
+    SYSTEM_EVENT_STA_CONNECTED,
+    SYSTEM_EVENT_STA_DISCONNECTED,
+    SYSTEM_EVENT_STA_AUTHMODE_CHANGE,
+    SYSTEM_EVENT_STA_GOT_IP,
+    SYSTEM_EVENT_STA_LOST_IP,
+} WiFiEvent_t;
+
+typedef struct {
+    uint32_t reason;
+} WiFiEventInfo_t;
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef std::function<void(WiFiEvent_t event, WiFiEventInfo_t info)> WiFiEventFuncCb;
+
+/**
+ * Host WiFi, starts out connected. Tests can change the status and
+ * raise events with setStatus/raiseEvent.
+ */
+class WiFiClass {
+   private:
+    wl_status_t _status = WL_CONNECTED;
+    IPAddress _localIP = IPAddress(127, 0, 0, 1);
+    std::vector<WiFiEventFuncCb> _callbacks;
+
+   public:
+    void onEvent(WiFiEventFuncCb cb) {
+        _callbacks.push_back(cb);
+    }
+
+    void raiseEvent(WiFiEvent_t event) {
+        WiFiEventInfo_t info = {0};
+        for (auto &cb : _callbacks)
+            cb(event, info);
+    }
+
+    void setStatus(wl_status_t status) {
+        _status = status;
+    }
+
+    wl_status_t status() {
+        return _status;
+    }
+
+    bool isConnected() {
+        return _status == WL_CONNECTED;
+    }
+
+    String macAddress() {
+        return String("24:0A:C4:00:00:01");
+    }
+
+    IPAddress localIP() {
+        return _localIP;
+    }
+
+    bool reconnect() {
+        return true;
+    }
+
+    bool disconnect(bool wifioff = false) {
+        return true;
+    }
+
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr) {
+        return _status;
+    }
+};
+
+extern WiFiClass WiFi;
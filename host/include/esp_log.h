@@ -0,0 +1,18 @@
+#pragma once
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/**
+ * @brief Writes to stderr if level is at or below the host log level.
+ * The host log level defaults to ESP_LOG_ERROR and can be changed with the
+ * HOMIE_HOST_LOG_LEVEL environment variable (0-5).
+ */
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
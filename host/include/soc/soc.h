@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+// The host has no DROM window, string literals end up in .rodata between the end
+// of the code and the start of the writable data of the executable instead.
+extern "C" const char etext[];
+extern "C" const char __data_start[];
+
+#define SOC_DROM_LOW ((uintptr_t)etext)
+#define SOC_DROM_HIGH ((uintptr_t)__data_start)
@@ -0,0 +1,46 @@
+#include <stdarg.h>
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+WiFiClass WiFi;
+
+unsigned long millis() {
+    return (unsigned long)(hostshim::wallMicros() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)hostshim::wallMicros();
+}
+
+void delay(uint32_t ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+long random(long max) {
+    return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+    return min >= max ? min : min + random(max - min);
+}
+
+static esp_log_level_t hostLogLevel() {
+    static esp_log_level_t level = [] {
+        const char *env = getenv("HOMIE_HOST_LOG_LEVEL");
+        return env ? (esp_log_level_t)atoi(env) : ESP_LOG_ERROR;
+    }();
+    return level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (level > hostLogLevel())
+        return;
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[%s] ", tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
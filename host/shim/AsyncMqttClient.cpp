@@ -0,0 +1,274 @@
+#include <AsyncMqttClient.h>
+
+uint16_t AsyncMqttClient::nextPacketId() {
+    if (++_packetId == 0)
+        _packetId = 1;
+    return _packetId;
+}
+
+AsyncMqttClient &AsyncMqttClient::setWill(const char *topic, uint8_t qos, bool retain, const char *payload,
+                                          size_t length) {
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setCleanSession(bool cleanSession) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _cleanSession = cleanSession;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onConnect(OnConnectUserCallback callback) {
+    _onConnect.push_back(callback);
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onDisconnect(OnDisconnectUserCallback callback) {
+    _onDisconnect.push_back(callback);
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onMessage(OnMessageUserCallback callback) {
+    _onMessage.push_back(callback);
+    return *this;
+}
+
+bool AsyncMqttClient::connected() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _connected;
+}
+
+void AsyncMqttClient::connect() {
+    bool sessionPresent;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _connected = true;
+        sessionPresent = !_cleanSession && _sessionStored;
+        if (!sessionPresent) {
+            _subscriptions.clear();
+            _wildcardSubscriptions.clear();
+        }
+        _sessionStored = !_cleanSession;
+    }
+    for (auto &cb : _onConnect)
+        cb(sessionPresent);
+}
+
+void AsyncMqttClient::disconnect(bool force) {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _connected = false;
+    }
+    for (auto &cb : _onDisconnect)
+        cb(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+}
+
+void AsyncMqttClient::setConnected(bool connected) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _connected = connected;
+}
+
+bool AsyncMqttClient::isWildcard(const char *filter) {
+    return strchr(filter, '+') || strchr(filter, '#');
+}
+
+void AsyncMqttClient::collectSubscribers(const std::string &topic, const std::string &payload, bool retain,
+                                         std::vector<Delivery> &out) {
+    // A client receives a message only once, even with overlapping subscriptions
+    auto it = _subscriptions.find(topic);
+    bool found = it != _subscriptions.end();
+    uint8_t qos = found ? it->second : 0;
+
+    for (auto sub = _wildcardSubscriptions.begin(); !found && sub != _wildcardSubscriptions.end(); sub++) {
+        if (topicMatches(sub->first.c_str(), topic.c_str())) {
+            found = true;
+            qos = sub->second;
+        }
+    }
+
+    if (found) {
+        Delivery d;
+        d.topic = topic;
+        d.payload = payload;
+        d.props.qos = qos;
+        d.props.dup = false;
+        d.props.retain = retain;
+        out.push_back(d);
+    }
+}
+
+void AsyncMqttClient::deliver(const std::vector<Delivery> &deliveries) {
+    for (auto const &d : deliveries) {
+        // AsyncMqttClient hands out mutable, not null terminated payloads
+        std::vector<char> topic(d.topic.begin(), d.topic.end());
+        topic.push_back('\0');
+        std::vector<char> payload(d.payload.begin(), d.payload.end());
+        payload.push_back('\0');
+        size_t total = d.payload.size();
+        size_t chunk = _chunkSize && total > _chunkSize ? _chunkSize : total;
+        size_t index = 0;
+        do {
+            size_t len = std::min(chunk, total - index);
+            for (auto &cb : _onMessage)
+                cb(topic.data(), payload.data() + index, d.props, len, index, total);
+            index += len;
+        } while (index < total);
+    }
+}
+
+uint16_t AsyncMqttClient::subscribe(const char *topic, uint8_t qos) {
+    std::vector<Delivery> deliveries;
+    uint16_t id;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (!_connected)
+            return 0;
+        id = nextPacketId();
+        if (_recording)
+            _records.push_back({RECORD_SUBSCRIBE, topic, "", qos, false});
+        _subscriptions[topic] = qos;
+
+        Delivery d;
+        d.props.qos = qos;
+        d.props.dup = false;
+        d.props.retain = true;
+        if (isWildcard(topic)) {
+            _wildcardSubscriptions[topic] = qos;
+            for (auto const &retained : _retained) {
+                if (topicMatches(topic, retained.first.c_str())) {
+                    d.topic = retained.first;
+                    d.payload = retained.second;
+                    deliveries.push_back(d);
+                }
+            }
+        } else {
+            auto retained = _retained.find(topic);
+            if (retained != _retained.end()) {
+                d.topic = retained->first;
+                d.payload = retained->second;
+                deliveries.push_back(d);
+            }
+        }
+    }
+    deliver(deliveries);
+    return id;
+}
+
+uint16_t AsyncMqttClient::unsubscribe(const char *topic) {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (!_connected)
+        return 0;
+    if (_recording)
+        _records.push_back({RECORD_UNSUBSCRIBE, topic, "", 0, false});
+    _subscriptions.erase(topic);
+    _wildcardSubscriptions.erase(topic);
+    return nextPacketId();
+}
+
+uint16_t AsyncMqttClient::publish(const char *topic, uint8_t qos, bool retain, const char *payload, size_t length,
+                                  bool dup, uint16_t message_id) {
+    std::vector<Delivery> deliveries;
+    uint16_t id;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (!_connected)
+            return 0;
+        std::string body;
+        if (payload)
+            body.assign(payload, length ? length : strlen(payload));
+
+        id = qos ? nextPacketId() : 1;
+        if (_recording)
+            _records.push_back({RECORD_PUBLISH, topic, body, qos, retain});
+
+        if (retain) {
+            if (body.empty())
+                _retained.erase(topic);
+            else
+                _retained[topic] = body;
+        }
+        // Echo to our own subscriptions, the broker sends live messages without the retain flag
+        collectSubscribers(topic, body, false, deliveries);
+    }
+    deliver(deliveries);
+    return id;
+}
+
+void AsyncMqttClient::setRetained(const char *topic, const char *payload) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _retained[topic] = payload;
+}
+
+void AsyncMqttClient::inject(const char *topic, const char *payload, bool retain) {
+    std::vector<Delivery> deliveries;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (retain)
+            _retained[topic] = payload;
+        collectSubscribers(topic, payload, false, deliveries);
+    }
+    deliver(deliveries);
+}
+
+void AsyncMqttClient::receive(char *topic, char *payload, size_t len, size_t index, size_t total, bool retain) {
+    AsyncMqttClientMessageProperties props;
+    props.qos = 1;
+    props.dup = false;
+    props.retain = retain;
+    for (auto &cb : _onMessage)
+        cb(topic, payload, props, len, index, total);
+}
+
+void AsyncMqttClient::setPayloadChunkSize(size_t chunkSize) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _chunkSize = chunkSize;
+}
+
+void AsyncMqttClient::setRecording(bool recording) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _recording = recording;
+}
+
+void AsyncMqttClient::clearRecords() {
+    std::lock_guard<std::mutex> guard(_lock);
+    _records.clear();
+}
+
+std::vector<AsyncMqttClient::Record> AsyncMqttClient::records() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _records;
+}
+
+size_t AsyncMqttClient::countRecords(RecordKind kind) const {
+    std::lock_guard<std::mutex> guard(_lock);
+    size_t count = 0;
+    for (auto const &r : _records) {
+        if (r.kind == kind)
+            count++;
+    }
+    return count;
+}
+
+size_t AsyncMqttClient::subscriptionCount() const {
+    std::lock_guard<std::mutex> guard(_lock);
+    return _subscriptions.size();
+}
+
+bool AsyncMqttClient::topicMatches(const char *filter, const char *topic) {
+    while (*filter) {
+        if (*filter == '#')
+            return true;
+
+        if (*filter == '+') {
+            while (*topic && *topic != '/')
+                topic++;
+            filter++;
+            continue;
+        }
+
+        if (*filter != *topic)
+            return false;
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
@@ -0,0 +1,316 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+
+struct HostTask {
+    std::string name;
+    TaskFunction_t code;
+    void *parameter;
+    bool suspended;
+    // Signalled on resume, and the condition variable the task currently blocks on
+    std::condition_variable resumed;
+    std::condition_variable *waitingOn;
+};
+
+// Ring buffer allocated on creation, like a FreeRTOS queue sending and receiving never allocates.
+struct HostQueue {
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head;
+    UBaseType_t count;
+    std::vector<uint8_t> storage;
+    std::condition_variable changed;
+
+    HostQueue(UBaseType_t length, UBaseType_t itemSize)
+        : length(length), itemSize(itemSize), head(0), count(0), storage(length * itemSize) {}
+
+    uint8_t *slot(UBaseType_t index) {
+        return storage.data() + ((head + index) % length) * itemSize;
+    }
+};
+
+struct HostTimer {
+    std::string name;
+    TickType_t period;
+    bool autoReload;
+    bool active;
+    void *id;
+    TimerCallbackFunction_t callback;
+};
+
+namespace {
+// One lock for all shim objects keeps suspend/resume simple, every queue and task has its own
+// condition variable though, so a change only wakes the tasks waiting for it.
+// The lock is leaked on purpose, parked tasks still wait on it while the process exits.
+std::mutex &g_lock = *new std::mutex();
+
+thread_local uint64_t t_delayedMillis = 0;
+const std::chrono::steady_clock::time_point g_start = std::chrono::steady_clock::now();
+
+thread_local HostTask *t_currentTask = nullptr;
+
+// Threads not created through the shim (the main thread, std::threads of a benchmark) get a task on first use
+HostTask *currentTask() {
+    if (!t_currentTask)
+        t_currentTask = new HostTask{"loopTask", nullptr, nullptr, false};
+    return t_currentTask;
+}
+
+void waitOn(std::unique_lock<std::mutex> &lock, std::condition_variable &cv) {
+    currentTask()->waitingOn = &cv;
+    cv.wait(lock);
+    currentTask()->waitingOn = nullptr;
+}
+
+void waitWhileSuspended(std::unique_lock<std::mutex> &lock) {
+    HostTask *task = currentTask();
+    while (task->suspended)
+        waitOn(lock, task->resumed);
+}
+
+// Waits on cv until pred holds or the timeout expires, portMAX_DELAY waits forever.
+template <typename Pred>
+bool waitFor(std::unique_lock<std::mutex> &lock, std::condition_variable &cv, TickType_t ticks, Pred pred) {
+    HostTask *task = currentTask();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks * portTICK_PERIOD_MS);
+    for (;;) {
+        waitWhileSuspended(lock);
+        if (pred())
+            return true;
+
+        task->waitingOn = &cv;
+        if (ticks == portMAX_DELAY) {
+            cv.wait(lock);
+        } else if (cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+            task->waitingOn = nullptr;
+            waitWhileSuspended(lock);
+            return pred();
+        }
+        task->waitingOn = nullptr;
+    }
+}
+
+void *taskTrampoline(void *arg) {
+    HostTask *task = (HostTask *)arg;
+    t_currentTask = task;
+    task->code(task->parameter);
+    return nullptr;
+}
+}  // namespace
+
+namespace hostshim {
+uint64_t delayedMillis() {
+    return t_delayedMillis;
+}
+
+uint64_t wallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_start).count();
+}
+}  // namespace hostshim
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                                void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask,
+                                BaseType_t xCoreID) {
+    HostTask *task = new HostTask{pcName ? pcName : "", pxTaskCode, pvParameters, false};
+    task->waitingOn = nullptr;
+    if (pxCreatedTask)
+        *pxCreatedTask = task;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, taskTrampoline, task);
+    pthread_attr_destroy(&attr);
+    return err == 0 ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask,
+                                   BaseType_t xCoreID) {
+    return xTaskCreateUniversal(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask, xCoreID);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask) {
+    return xTaskCreateUniversal(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask,
+                                tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+    if (xTaskToDelete == nullptr || xTaskToDelete == currentTask()) {
+        // The handle may still be referenced by the library, so it is intentionally leaked.
+        pthread_exit(nullptr);
+    }
+    // Deleting other tasks is not supported, park them forever instead.
+    vTaskSuspend(xTaskToDelete);
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+    t_delayedMillis += xTicksToDelay * portTICK_PERIOD_MS;
+    std::unique_lock<std::mutex> lock(g_lock);
+    if (xTicksToDelay == 0) {
+        waitWhileSuspended(lock);
+        lock.unlock();
+        sched_yield();
+        return;
+    }
+    // Nothing signals this one, the delay is waited out
+    std::condition_variable sleeping;
+    waitFor(lock, sleeping, xTicksToDelay, [] { return false; });
+    waitWhileSuspended(lock);
+}
+
+void vTaskSuspend(TaskHandle_t xTaskToSuspend) {
+    std::unique_lock<std::mutex> lock(g_lock);
+    HostTask *task = xTaskToSuspend ? xTaskToSuspend : currentTask();
+    task->suspended = true;
+    if (task == currentTask())
+        waitWhileSuspended(lock);
+}
+
+void vTaskResume(TaskHandle_t xTaskToResume) {
+    std::lock_guard<std::mutex> guard(g_lock);
+    xTaskToResume->suspended = false;
+    if (xTaskToResume->waitingOn)
+        xTaskToResume->waitingOn->notify_all();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return currentTask();
+}
+
+char *pcTaskGetTaskName(TaskHandle_t xTaskToQuery) {
+    HostTask *task = xTaskToQuery ? xTaskToQuery : currentTask();
+    return &task->name[0];
+}
+
+BaseType_t xPortGetCoreID() {
+    return 0;
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(hostshim::wallMicros() / 1000);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+    return new HostQueue(uxQueueLength, uxItemSize);
+}
+
+void vQueueDelete(QueueHandle_t xQueue) {
+    delete xQueue;
+}
+
+static BaseType_t queueSend(QueueHandle_t q, const void *item, TickType_t ticks, bool front) {
+    std::unique_lock<std::mutex> lock(g_lock);
+    if (!waitFor(lock, q->changed, ticks, [q] { return q->count < q->length; }))
+        return pdFAIL;
+
+    if (front) {
+        q->head = (q->head + q->length - 1) % q->length;
+        if (q->itemSize)
+            memcpy(q->slot(0), item, q->itemSize);
+    } else if (q->itemSize) {
+        memcpy(q->slot(q->count), item, q->itemSize);
+    }
+    q->count++;
+    q->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait) {
+    return queueSend(xQueue, pvItemToQueue, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait) {
+    return queueSend(xQueue, pvItemToQueue, xTicksToWait, true);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait) {
+    std::unique_lock<std::mutex> lock(g_lock);
+    if (!waitFor(lock, xQueue->changed, xTicksToWait, [xQueue] { return xQueue->count > 0; }))
+        return pdFAIL;
+
+    if (xQueue->itemSize)
+        memcpy(pvBuffer, xQueue->slot(0), xQueue->itemSize);
+    xQueue->head = (xQueue->head + 1) % xQueue->length;
+    xQueue->count--;
+    xQueue->changed.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+    std::lock_guard<std::mutex> guard(g_lock);
+    return xQueue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue) {
+    std::lock_guard<std::mutex> guard(g_lock);
+    return xQueue->length - xQueue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+    xSemaphoreGive(sem);
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait) {
+    uint8_t dummy;
+    return xQueueReceive(xSemaphore, &dummy, xTicksToWait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+    return xQueueSendToBack(xSemaphore, nullptr, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore) {
+    vQueueDelete(xSemaphore);
+}
+
+TimerHandle_t xTimerCreate(const char *pcTimerName, TickType_t xTimerPeriodInTicks, UBaseType_t uxAutoReload,
+                           void *pvTimerID, TimerCallbackFunction_t pxCallbackFunction) {
+    return new HostTimer{pcTimerName ? pcTimerName : "", xTimerPeriodInTicks, uxAutoReload != pdFALSE, false,
+                         pvTimerID, pxCallbackFunction};
+}
+
+void *pvTimerGetTimerID(TimerHandle_t xTimer) {
+    return xTimer->id;
+}
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait) {
+    std::lock_guard<std::mutex> guard(g_lock);
+    xTimer->active = true;
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait) {
+    std::lock_guard<std::mutex> guard(g_lock);
+    xTimer->active = false;
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait) {
+    std::lock_guard<std::mutex> guard(g_lock);
+    xTimer->period = xNewPeriod;
+    xTimer->active = true;
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer) {
+    std::lock_guard<std::mutex> guard(g_lock);
+    return xTimer->active ? pdTRUE : pdFALSE;
+}
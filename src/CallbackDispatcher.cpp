@@ -0,0 +1,127 @@
+#include <CallbackDispatcher.hpp>
+#include <Node.hpp>
+#include <Property.hpp>
+
+CallbackDispatcher::CallbackDispatcher(MessagePool &pool) : _pool(pool) {
+}
+
+bool CallbackDispatcher::setLaneCount(uint8_t lanes) {
+    if (_started) {
+        log_e("The callback lanes are already running, set the lane count before the device is set up");
+        return false;
+    }
+    _laneCount = lanes;
+    return true;
+}
+
+void CallbackDispatcher::begin(ModelArena &arena) {
+    if (_started)
+        return;
+    _started = true;
+    if (_laneCount == 0)
+        return;
+
+    _lanes = arena.allocateArray<Lane>(_laneCount);
+    _idle = xSemaphoreCreateBinary();
+    for (uint8_t i = 0; i < _laneCount; i++) {
+        Lane &lane = _lanes[i];
+        lane.dispatcher = this;
+        lane.queue = xQueueCreate(HOMIE_CALLBACK_LANE_QUEUE, sizeof(Job));
+        lane.stats = CallbackLaneStats();
+
+        char name[20];
+        snprintf(name, sizeof(name), "homie_lane_%u", i);
+        xTaskCreateUniversal(
+            this->laneTaskCode,
+            name,
+            8192,
+            &lane,
+            3,
+            &lane.task,
+            CONFIG_HOMIE_CALLBACK_RUNNING_CORE < 0 ? i % portNUM_PROCESSORS : CONFIG_HOMIE_CALLBACK_RUNNING_CORE);
+    }
+}
+
+void CallbackDispatcher::run(Property &property, PublishQueueElement *elm) {
+    // Add check to prevent processing our own published values
+    if (strcmp(property.getValue(), elm->payload) != 0) {
+        log_v("Found a matching callback for topic '%s' property: %s(%s)", elm->topic,
+              property.getName(), property.getId());
+
+        PropertySetCallback callback = property.getCallback();
+        if (callback == nullptr) {
+            property.setValue(elm->payload);
+        } else {
+            String v = callback(property, elm->payload);
+            property.setValue(v);
+        }
+    }
+    _pool.release(elm);
+}
+
+void CallbackDispatcher::dispatch(Property &property, PublishQueueElement *elm) {
+    if (!_lanes) {
+        run(property, elm);
+        return;
+    }
+
+    Lane &lane = _lanes[property.getParent().getCallbackLane() % _laneCount];
+    Job job = {&property, elm, micros()};
+    __atomic_add_fetch(&_inFlight, 1, __ATOMIC_ACQ_REL);
+    xQueueSendToBack(lane.queue, &job, portMAX_DELAY);
+
+    // Only the incoming task dispatches, so it is the only one writing maxDepth
+    uint32_t depth = uxQueueMessagesWaiting(lane.queue);
+    if (depth > lane.stats.maxDepth)
+        lane.stats.maxDepth = depth;
+}
+
+void CallbackDispatcher::laneTaskCode(void *parameter) {
+    Lane &lane = *(Lane *)parameter;
+    for (;;) {
+        Job job;
+        if (!xQueueReceive(lane.queue, &job, portMAX_DELAY))
+            continue;
+
+        lane.dispatcher->run(*job.property, job.elm);
+        if (__atomic_sub_fetch(&lane.dispatcher->_inFlight, 1, __ATOMIC_ACQ_REL) == 0)
+            xSemaphoreGive(lane.dispatcher->_idle);
+
+        uint32_t latency = micros() - job.queuedAt;
+        lane.stats.dispatched++;
+        lane.stats.totalLatency += latency;
+        if (latency > lane.stats.maxLatency)
+            lane.stats.maxLatency = latency;
+    }
+}
+
+bool CallbackDispatcher::waitIdle() {
+    if (!_lanes)
+        return true;
+
+    unsigned long stamp = millis();
+    // The semaphore may still be given from an earlier time the lanes ran idle, so the count decides
+    while (__atomic_load_n(&_inFlight, __ATOMIC_ACQUIRE)) {
+        unsigned long elapsed = millis() - stamp;
+        if (elapsed >= HOMIE_CALLBACK_IDLE_TIMEOUT_MS ||
+            !xSemaphoreTake(_idle, pdMS_TO_TICKS(HOMIE_CALLBACK_IDLE_TIMEOUT_MS - elapsed))) {
+            log_w("Callback lanes still busy after %d ms, %d callbacks didnt return", millis() - stamp,
+                  __atomic_load_n(&_inFlight, __ATOMIC_ACQUIRE));
+            return false;
+        }
+    }
+    log_v("Callback lanes idle after %d ms", millis() - stamp);
+    return true;
+}
+
+size_t CallbackDispatcher::getDepth(uint8_t lane) {
+    if (lane >= _laneCount || !_lanes)
+        return 0;
+    return uxQueueMessagesWaiting(_lanes[lane].queue);
+}
+
+CallbackLaneStats CallbackDispatcher::getStats(uint8_t lane) {
+    if (lane >= _laneCount || !_lanes)
+        return CallbackLaneStats();
+    return _lanes[lane].stats;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <AsyncMqttClient.h>
+
+#include <MessagePool.hpp>
+#include <ModelArena.hpp>
+
+#include "MqttLogger.hpp"
+
+#undef TAG
+#define TAG "Home_Dispatcher"
+
+// Worker tasks running the set callbacks, 0 runs them on the incoming task itself. Lanes run the callbacks
+// of different nodes at the same time, so they are opt in for callbacks that dont share a bus or state.
+#ifndef HOMIE_CALLBACK_LANES
+#define HOMIE_CALLBACK_LANES 0
+#endif
+
+// Messages a lane can hold before the incoming task waits for it
+#ifndef HOMIE_CALLBACK_LANE_QUEUE
+#define HOMIE_CALLBACK_LANE_QUEUE 16
+#endif
+
+// Longest the restore waits for the callbacks still running on the lanes
+#ifndef HOMIE_CALLBACK_IDLE_TIMEOUT_MS
+#define HOMIE_CALLBACK_IDLE_TIMEOUT_MS 5000
+#endif
+
+// -1 spreads the lanes over all cores
+#ifndef CONFIG_HOMIE_CALLBACK_RUNNING_CORE
+#define CONFIG_HOMIE_CALLBACK_RUNNING_CORE -1
+#endif
+
+class Property;
+
+struct CallbackLaneStats {
+    uint32_t dispatched;
+    // Most messages that waited in the lane at the same time
+    uint32_t maxDepth;
+    // Time from handing the message to the lane until its callback returned, in us
+    uint32_t maxLatency;
+    uint64_t totalLatency;
+};
+
+/**
+ * @brief Runs the set callbacks of incoming messages on a few worker tasks, the lanes.
+ *
+ * All properties of a node share a lane, so the messages of a node are handled
+ * one after the other in the order they arrived, while a slow callback of one
+ * node doesnt hold up the nodes on other lanes. Nodes are assigned round robin,
+ * Node::setCallbackLane() moves a node, e.g. to give a slow one a lane of its own.
+ * Callbacks of different nodes can run at the same time.
+ */
+class CallbackDispatcher {
+   private:
+    struct Job {
+        Property *property;
+        PublishQueueElement *elm;
+        unsigned long queuedAt;
+    };
+
+    struct Lane {
+        CallbackDispatcher *dispatcher;
+        QueueHandle_t queue;
+        TaskHandle_t task;
+        CallbackLaneStats stats;
+    };
+
+    MessagePool &_pool;
+    Lane *_lanes = nullptr;
+    uint8_t _laneCount = HOMIE_CALLBACK_LANES;
+    bool _started = false;
+    // Jobs handed to a lane whose callback didnt return yet
+    uint32_t _inFlight = 0;
+    // Given by the lane that finished the last job in flight
+    SemaphoreHandle_t _idle = nullptr;
+
+    static void laneTaskCode(void *parameter);
+
+    void run(Property &property, PublishQueueElement *elm);
+
+   public:
+    CallbackDispatcher(MessagePool &pool);
+
+    /**
+     * @brief Set the number of lanes, only possible before the device is set up.
+     *
+     * @param lanes 0 runs the callbacks on the incoming task
+     */
+    bool setLaneCount(uint8_t lanes);
+
+    uint8_t getLaneCount() {
+        return _laneCount;
+    }
+
+    /**
+     * @brief Creates the lane tasks, called once by the device setup.
+     *
+     * @param arena the lanes are allocated from, like the rest of the model
+     */
+    void begin(ModelArena &arena);
+
+    /**
+     * @brief Hands the message to the lane of the node of the property, waits if the lane is full.
+     * The lane releases the message to the pool once it is handled.
+     */
+    void dispatch(Property &property, PublishQueueElement *elm);
+
+    /**
+     * @brief Waits until the lanes ran every job handed to them. Called with the incoming task suspended,
+     * so the lanes stay idle afterwards, e.g. while the restore applies values.
+     *
+     * @return false if a callback still ran after HOMIE_CALLBACK_IDLE_TIMEOUT_MS
+     */
+    bool waitIdle();
+
+    /**
+     * @brief Messages waiting in the lane right now.
+     */
+    size_t getDepth(uint8_t lane);
+
+    CallbackLaneStats getStats(uint8_t lane);
+};
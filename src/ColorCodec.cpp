@@ -0,0 +1,154 @@
+#include <ColorCodec.hpp>
+#include <string.h>
+
+static const uint16_t maxHsv[] = {360, 100, 100};
+static const uint16_t maxRgb[] = {255, 255, 255};
+
+HomieColorSpace ColorCodec::spaceOf(const char *format) {
+    if (!format)
+        return COLOR_UNKNOWN;
+    if (strcmp(format, "hsv") == 0)
+        return COLOR_HSV;
+    if (strcmp(format, "rgb") == 0)
+        return COLOR_RGB;
+    return COLOR_UNKNOWN;
+}
+
+uint16_t ColorCodec::maxOf(HomieColorSpace space, int i) {
+    switch (space) {
+        case COLOR_HSV:
+            return maxHsv[i];
+        case COLOR_RGB:
+            return maxRgb[i];
+        default:
+            return 0;
+    }
+}
+
+bool ColorCodec::parse(const char *value, HomieColor &color) {
+    uint16_t *components[] = {&color.h, &color.s, &color.v};
+    const char *pos = value;
+    for (int i = 0; i < 3; i++) {
+        if (*pos < '0' || *pos > '9')
+            return false;
+
+        uint32_t component = 0;
+        for (; *pos >= '0' && *pos <= '9'; pos++) {
+            component = component * 10 + (*pos - '0');
+            if (component > UINT16_MAX)
+                return false;
+        }
+        if (*pos == '.') {
+            // Only the first decimal decides the rounding
+            pos++;
+            if (*pos >= '5' && *pos <= '9')
+                component++;
+            while (*pos >= '0' && *pos <= '9')
+                pos++;
+            if (component > UINT16_MAX)
+                return false;
+        }
+        *components[i] = component;
+
+        if (*pos != (i < 2 ? ',' : '\0'))
+            return false;
+        pos++;
+    }
+    return true;
+}
+
+// Writes value as decimal, returns the position after the last digit
+static char *formatComponent(char *dst, uint16_t value) {
+    char reversed[5];
+    int len = 0;
+    do {
+        reversed[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (len)
+        *dst++ = reversed[--len];
+    return dst;
+}
+
+size_t ColorCodec::format(char *dst, const HomieColor &color) {
+    char *pos = formatComponent(dst, color.h);
+    *pos++ = ',';
+    pos = formatComponent(pos, color.s);
+    *pos++ = ',';
+    pos = formatComponent(pos, color.v);
+    *pos = '\0';
+    return pos - dst;
+}
+
+bool ColorCodec::clamp(HomieColor &color, HomieColorSpace space) {
+    uint16_t *components[] = {&color.h, &color.s, &color.v};
+    bool inBounds = true;
+    for (int i = 0; i < 3; i++) {
+        uint16_t max = maxOf(space, i);
+        if (*components[i] > max) {
+            *components[i] = max;
+            inBounds = false;
+        }
+    }
+    return inBounds;
+}
+
+// a * b / c rounded to the nearest integer
+static uint16_t scale(uint32_t a, uint32_t b, uint32_t c) {
+    return (a * b + c / 2) / c;
+}
+
+HomieColor ColorCodec::hsvToRgb(const HomieColor &hsv) {
+    uint16_t hue = hsv.h % 360;
+    uint32_t s = hsv.s > 100 ? 100 : hsv.s;
+    uint32_t v = scale(hsv.v > 100 ? 100 : hsv.v, 255, 100);
+
+    // Position inside the sixth of the hue circle, in 1/60
+    uint32_t rem = hue % 60;
+    uint16_t p = scale(v, 100 - s, 100);
+    uint16_t q = scale(v, 6000 - s * rem, 6000);
+    uint16_t t = scale(v, 6000 - s * (60 - rem), 6000);
+
+    switch (hue / 60) {
+        case 0:
+            return {(uint16_t)v, t, p};
+        case 1:
+            return {q, (uint16_t)v, p};
+        case 2:
+            return {p, (uint16_t)v, t};
+        case 3:
+            return {p, q, (uint16_t)v};
+        case 4:
+            return {t, p, (uint16_t)v};
+        default:
+            return {(uint16_t)v, p, q};
+    }
+}
+
+HomieColor ColorCodec::rgbToHsv(const HomieColor &rgb) {
+    int32_t r = rgb.h > 255 ? 255 : rgb.h;
+    int32_t g = rgb.s > 255 ? 255 : rgb.s;
+    int32_t b = rgb.v > 255 ? 255 : rgb.v;
+    int32_t max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    int32_t min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+    int32_t delta = max - min;
+
+    HomieColor hsv;
+    hsv.v = scale(max, 100, 255);
+    hsv.s = max ? scale(delta, 100, max) : 0;
+    if (delta == 0) {
+        hsv.h = 0;
+        return hsv;
+    }
+
+    // Hue in 1/60 of the sixth it lies in, rounded
+    int32_t hue;
+    if (max == r)
+        hue = (60 * (g - b) + (g >= b ? delta / 2 : -delta / 2)) / delta;
+    else if (max == g)
+        hue = 120 + (60 * (b - r) + (b >= r ? delta / 2 : -delta / 2)) / delta;
+    else
+        hue = 240 + (60 * (r - g) + (r >= g ? delta / 2 : -delta / 2)) / delta;
+    hsv.h = (hue + 360) % 360;
+    return hsv;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <HomieDatatype.hpp>
+
+typedef enum {
+    COLOR_UNKNOWN,
+    COLOR_HSV,
+    COLOR_RGB,
+} HomieColorSpace;
+
+// Longest text of a color incl. terminator, "65535,65535,65535"
+#define HOMIE_COLOR_TEXT_LEN 18
+
+/**
+ * @brief Reads and writes the "a,b,c" payloads of color properties.
+ * Hand written instead of sscanf/sprintf, works on the callers buffers and never allocates.
+ *
+ * hsv components are hue 0-360, saturation and value 0-100, rgb components are 0-255.
+ */
+class ColorCodec {
+   public:
+    /**
+     * @brief Color space of a $format, COLOR_UNKNOWN for anything but "hsv" and "rgb".
+     */
+    static HomieColorSpace spaceOf(const char *format);
+
+    /**
+     * @brief Upper limit of component i (0-2) in the color space.
+     */
+    static uint16_t maxOf(HomieColorSpace space, int i);
+
+    /**
+     * @brief Parses "a,b,c". Components may have a fraction, e.g. OpenHab sends floats, they are rounded.
+     *
+     * @return false if the text isnt three non negative numbers
+     */
+    static bool parse(const char *value, HomieColor &color);
+
+    /**
+     * @brief Writes "a,b,c" to dst, which has to hold HOMIE_COLOR_TEXT_LEN bytes.
+     *
+     * @return size_t length without the terminator
+     */
+    static size_t format(char *dst, const HomieColor &color);
+
+    /**
+     * @brief Limits the components to the color space.
+     *
+     * @return false if a component had to be changed
+     */
+    static bool clamp(HomieColor &color, HomieColorSpace space);
+
+    static HomieColor hsvToRgb(const HomieColor &hsv);
+
+    static HomieColor rgbToHsv(const HomieColor &rgb);
+};
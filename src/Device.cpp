@@ -23,33 +23,37 @@ const char *stateEnumToString(HomieDeviceState e) {
     }
 }
 
-Device::Device(AsyncMqttClient &client, const char *id, uint8_t buffSize) : _client(client),
-                                                                            _extensions(nullptr) {
-    char *idBuff = new char[strlen(id) + 1];
-    strcpy(idBuff, id);
-    _id = idBuff;
+Device::Device(AsyncMqttClient &client, const char *id) : _client(client),
+                                                                            _extensions(nullptr),
+                                                                            _messagePool(HOMIE_INCOMING_MSG_QUEUE),
+                                                                            _callbackDispatcher(_messagePool),
+                                                                            _publishScheduler(client) {
+    if (HOMIE_MODEL_ARENA_SIZE)
+        _arena.reserve(HOMIE_MODEL_ARENA_SIZE);
+
+    _id = _arena.intern(id);
     _name = _id;
 
-    char *topic = new char[6 + strlen(_id) + 2];  // last + 6 for range _65536, last + 4 for /set
+    char *topic = (char *)_arena.allocate(6 + strlen(_id) + 2, 1);
     strcpy(topic, "homie/");
     strcat(topic, _id);
     strcat(topic, "/");
     _topic = topic;
 
-    char *topicLw = new char[strlen(topic) + 6 + 1];  // last + 6 for range _65536, last + 4 for /set
+    char *topicLw = (char *)_arena.allocate(strlen(topic) + 6 + 1, 1);
     strcpy(topicLw, topic);
     strcat(topicLw, "$state");
     _lwTopic = topicLw;
 
-    const char *macFromWifi = WiFi.macAddress().c_str();
-    char *macBuff = new char[strlen(macFromWifi) + 1];
-    strcpy(macBuff, macFromWifi);
-    _mac = macBuff;
+    // Outside of homie/, where controllers would take it for an attribute of the device. Next to the log topics.
+    char *topicSentinel = (char *)_arena.allocate(6 + strlen(_id) + 8 + 1, 1);
+    strcpy(topicSentinel, "debug/");
+    strcat(topicSentinel, _id);
+    strcat(topicSentinel, "/restore");
+    _sentinelTopic = topicSentinel;
 
-    const char *homieVersion = HOMIE_VER;
-    char *versionBuff = new char[strlen(homieVersion) + 1];
-    strcpy(versionBuff, homieVersion);
-    _homieVersion = versionBuff;
+    _mac = _arena.intern(WiFi.macAddress().c_str());
+    _homieVersion = HOMIE_VER;
 
     log_i("Setting LW to: %s", _lwTopic);
     _client.setWill(_lwTopic, 2, true, "lost");
@@ -71,11 +75,15 @@ Device::Device(AsyncMqttClient &client, const char *id, uint8_t buffSize) : _cli
         onWiFiEventCallback(event);
     });
 
-    _workingBuffer = new char[buffSize];
-
     _newMqttMessageQueue = xQueueCreate(HOMIE_INCOMING_MSG_QUEUE, sizeof(PublishQueueElement *));
+    _connectionLock = xSemaphoreCreateMutex();
+    _initLock = xSemaphoreCreateMutex();
+
+    addStats("restoretime", [this](Stats &stat) {
+        stat.setValue((int)_restoreDuration);
+    });
 
-    TimerArguments *args = new TimerArguments();
+    TimerArguments *args = _arena.create<TimerArguments>();
     args->device = this;
 
     _mqttReconnectTimer = xTimerCreate(
@@ -123,10 +131,19 @@ Device::Device(AsyncMqttClient &client, const char *id, uint8_t buffSize) : _cli
 }
 
 Node &Device::addNode(const char *id) {
-    Node &n = *new Node(*this, _client, id);
-    this->_nodes.push_back(&n);
+    return addNode(*_arena.create<Node>(*this, _client, id));
+}
 
-    return n;
+Node &Device::addNode(const HomieNodeSpec &spec) {
+    return addNode(*_arena.create<Node>(*this, _client, spec));
+}
+
+Node &Device::addNode(Node &node) {
+    node.setCallbackLane(_nodes.size());
+    this->_nodes.push_back(&node);
+    _nodesPayload = nullptr;
+
+    return node;
 }
 
 Node &Device::addNode(const char *id, const char *name, const char *type) {
@@ -143,6 +160,8 @@ void Device::setup() {
         return;
     }
 
+    _callbackDispatcher.begin(_arena);
+
     if (!_name || !_id) {
         this->setState(DSTATE_ALERT);
         log_e("The devices Name or ID is not set. Name:'%s' ID: '%s'", _name ? _name : "UNDEFINED", _id ? _id : "UNDEFINED");
@@ -153,37 +172,33 @@ void Device::setup() {
     log_i("Device-Setup Base-Topic '%s'", _topic);
     setState(DSTATE_INIT);
 
-    _client.publish(prefixedTopic(_workingBuffer, "$state"), 1, true, stateEnumToString(_state));
-    _client.publish(prefixedTopic(_workingBuffer, "$homie"), 1, true, _homieVersion);
-    _client.publish(prefixedTopic(_workingBuffer, "$name"), 1, true, _name);
-    _client.publish(prefixedTopic(_workingBuffer, "$extensions"), 1, true, _extensions);
-    _client.publish(prefixedTopic(_workingBuffer, "$mac"), 1, true, _mac);
-    _client.publish(prefixedTopic(_workingBuffer, "$localip"), 1, true, _ip.toString().c_str());
-    _client.publish(prefixedTopic(_workingBuffer, "$stats/interval"), 1, true, String(_statsInterval).c_str());
-
-    String statIds((char *)0);
-    // We only assume that every Stat is of max length 12, in my case it is!
-    statIds.reserve(_stats.size() * 13);
-
-    for (auto const &stat : _stats) {
-        statIds.concat(stat->getId());
-        statIds.concat(",");
-    }
-    if (_stats.size() > 0)
-        statIds.remove(statIds.length() - 1);
-    _client.publish(prefixedTopic(_workingBuffer, "$stats"), 1, true, statIds.c_str());
+    MqttLogger::init(&_client, _id);
 
-    String nodeNames((char *)0);
-    // We only assume thath every node name max len is 12, in my case it is!
-    nodeNames.reserve(_nodes.size() * 13);
-    for (auto const &node : _nodes) {
-        nodeNames.concat(node->getId());
-        nodeNames.concat(",");
+    _maxTopicLen = computeMaxTopicLength();
+    TopicBuilder topic(_maxTopicLen, _topic);
+
+    _client.publish(_lwTopic, 1, true, stateEnumToString(_state));
+    _client.publish(topic.with("$homie"), _attributeQos, true, _homieVersion);
+    _client.publish(topic.with("$name"), _attributeQos, true, _name);
+    _client.publish(topic.with("$extensions"), _attributeQos, true, _extensions);
+    _client.publish(topic.with("$mac"), _attributeQos, true, _mac);
+    _client.publish(topic.with("$localip"), _attributeQos, true, _ip.toString().c_str());
+    _client.publish(topic.with("$stats/interval"), _attributeQos, true, String(_statsInterval).c_str());
+
+    // Built once, a setup that is repeated after an interrupted restore reuses them
+    if (!_statsPayload)
+        _statsPayload = joinIds(_stats, _arena);
+    _client.publish(topic.with("$stats"), _attributeQos, true, _statsPayload);
+
+    if (!_nodesPayload)
+        _nodesPayload = joinIds(_nodes, _arena);
+    _client.publish(topic.with("$nodes"), _attributeQos, true, _nodesPayload);
+
+    // The model is complete now, the index stays frozen from here on
+    if (!freezeModel()) {
+        setState(DSTATE_ALERT);
+        return;
     }
-    if (_nodes.size() > 0)
-        nodeNames.remove(nodeNames.length() - 1);
-
-    _client.publish(prefixedTopic(_workingBuffer, "$nodes"), 1, true, nodeNames.c_str());
 
     for (auto const &node : _nodes) {
         if (!node->setup()) {
@@ -191,13 +206,61 @@ void Device::setup() {
             log_e("Error while setting up node: ", node->getName() ? node->getName() : "UNDEFINED", node->getId() ? node->getId() : "UNDEFINED");
         };
     }
+
+    if (_subscribeMode == SUBSCRIBE_WILDCARD)
+        subscribeWildcard();
 }
 
-char *Device::prefixedTopic(char *buff, const char *d) {
-    strcpy(buff, _topic);
-    strcat(buff, d);
-    // log_v("Prefixed Topic Device: %s", buff);
-    return buff;
+bool Device::freezeModel() {
+    if (_topicIndex.isFrozen())
+        return true;
+
+    if (!_topicIndex.build(_topic, _nodes, _arena))
+        return false;
+    _publishScheduler.reserve(_topicIndex.size());
+    return true;
+}
+
+bool Device::setLastValueStore(LastValueStore &store) {
+    if (!freezeModel() || !_lastValues.begin(store, _topicIndex, _arena))
+        return false;
+
+    unsigned long stamp = millis();
+    char record[LastValueCache::RECORD_SIZE];
+    for (uint16_t i = 0; i < _topicIndex.size(); i++) {
+        Property &property = *_topicIndex.get(i);
+        bool published;
+        const char *value = _lastValues.read(property, record, published);
+        if (!value)
+            continue;
+
+        // Like a restored value, just without publishing it. The restore decides if it or the broker wins.
+        PropertySetCallback callback = property.getCallback();
+        if (callback == nullptr) {
+            property.setDefaultValue(value);
+        } else {
+            String v = callback(property, value);
+            property.setDefaultValue(v);
+        }
+        _lastValues.loaded(property, published);
+    }
+    log_i("Loaded %d last values in %d ms", _lastValues.getLoadedCount(), millis() - stamp);
+    return true;
+}
+
+size_t Device::computeMaxTopicLength() {
+    // Device attributes, "$stats/interval" is the longest fixed one
+    size_t longest = strlen("$stats/interval");
+    for (auto const &stat : _stats)
+        longest = max(longest, strlen("$stats/") + strlen(stat->getId()));
+
+    for (auto const &node : _nodes) {
+        size_t nodeLen = strlen(node->getId()) + 1;
+        longest = max(longest, nodeLen + strlen("$properties"));
+        for (auto const &prop : node->getProperties())
+            longest = max(longest, nodeLen + strlen(prop->getId()) + strlen("/$datatype"));
+    }
+    return strlen(_topic) + longest;
 }
 
 void Device::init() {
@@ -217,23 +280,92 @@ void Device::init() {
 
     MqttLogger::init(&_client, _id);
 
-    _client.publish(prefixedTopic(_workingBuffer, "$localip"), 1, true, _ip.toString().c_str());
+    TopicBuilder topic(_maxTopicLen, _topic);
+    _client.publish(topic.with("$localip"), _attributeQos, true, _ip.toString().c_str());
     for (auto const &node : _nodes) {
         node->init();
     }
+
+    if (_subscribeMode == SUBSCRIBE_WILDCARD)
+        subscribeWildcard();
 }
 
-void Device::registerSettableProperty(Property &property) {
-    log_v("Added new callback to map for property %s (%s) with topic: '%s' and topicSet: '%s'",
-          property.getName(), property.getId(), property.getTopic(), property.getTopicSet());
+void Device::resume() {
+    log_v("Device-Resume Base-Topic '%s'", _topic);
+
+    // Our address may have changed while we were gone
+    TopicBuilder topic(_maxTopicLen, _topic);
+    _client.publish(topic.with("$localip"), _attributeQos, true, _ip.toString().c_str());
+}
+
+bool Device::becomeReady(uint32_t connection) {
+    xSemaphoreTake(_connectionLock, portMAX_DELAY);
+    bool current = connection == _connection;
+    if (current) {
+        // The broker published our last will, $state has to be set again
+        setState(DSTATE_READY);
+        _client.publish(_lwTopic, 1, true, stateEnumToString(_state));
+        // The values set while we were gone or restoring, or that failed to publish
+        _publishScheduler.release();
+        vTaskResume(_taskNewMqttMessages);
+        vTaskResume(_taskStatsHandling);
+    }
+    xSemaphoreGive(_connectionLock);
+
+    if (current && _setupDone && !_setupAnnounced) {
+        _setupAnnounced = true;
+        for (auto callback : _onDeviceSetupDoneCallbacks)
+            callback(*this);
+    }
+    return current;
+}
+
+void Device::subscribeWildcard() {
+    bool settable = false;
+    bool retained = false;
+    for (auto const &node : _nodes) {
+        settable |= node->hasSettableProperty(false);
+        retained |= node->hasSettableProperty(true);
+    }
+
+    // The retained values come in through "+/+" until the restore is done, unmatched topics are dropped on arrival
+    TopicBuilder topic(_maxTopicLen, _topic);
+    if (retained)
+        _client.subscribe(topic.with("+/+"), 1);
+    if (settable)
+        _client.subscribe(topic.with("+/+/set"), 1);
+}
+
+void Device::unsubscribeRestoreFilters() {
+    if (_subscribeMode == SUBSCRIBE_PER_NODE) {
+        for (auto const &node : _nodes)
+            node->unsubscribeRestoreFilter();
+    } else if (_subscribeMode == SUBSCRIBE_WILDCARD) {
+        for (auto const &node : _nodes) {
+            if (node->hasSettableProperty(true)) {
+                TopicBuilder topic(_maxTopicLen, _topic);
+                _client.unsubscribe(topic.with("+/+"));
+                return;
+            }
+        }
+    }
+}
 
-    _topicCallbacks[property.getTopicSet()] = &property;
-    vTaskDelay(pdMS_TO_TICKS(20));
+void Device::registerSettableProperty(Property &property) {
+    log_v("Added new callback to map for property %s (%s)", property.getName(), property.getId());
 
-    if (property.isRetained()) {
-        _topicCallbacks[property.getTopic()] = &property;
-        vTaskDelay(pdMS_TO_TICKS(20));
+    if (!_topicIndex.add(property, TOPIC_SET)) {
+        log_e("Property %s (%s) isnt part of the topic index, was it added after setup?", property.getName(), property.getId());
+        return;
     }
+
+    if (property.isRetained())
+        _topicIndex.add(property, TOPIC_DATA);
+}
+
+void Device::registerSettableProperties(Node &node) {
+    size_t count = _topicIndex.addNode(node);
+    log_v("Registered %d settable properties of node %s (%s)", count, node.getName(), node.getId());
 }
 //
 void Device::onMessageReceivedCallback(char *topicCharPtr, char *payloadCharPtr, AsyncMqttClientMessageProperties properties,
@@ -241,193 +373,185 @@ void Device::onMessageReceivedCallback(char *topicCharPtr, char *payloadCharPtr,
     if (len == 0)
         return;
 
-    if (index + len != total) {
-        log_e("Received a multipart message, not implemented yet!");
+    // The wildcard filters also match values and attributes that arent for us, they dont get a slot
+    if (index == 0 && _subscribeMode != SUBSCRIBE_PER_TOPIC && strncmp(topicCharPtr, _topic, strlen(_topic)) == 0 &&
+        !_topicIndex.find(topicCharPtr) && strcmp(topicCharPtr, _sentinelTopic) != 0) {
+        log_v("Dropping message on topic '%s', no registered property", topicCharPtr);
+        return;
     }
 
-    char *payload = new char[len + 1];
-    strncpy(payload, payloadCharPtr, len);
-    payload[len] = '\0';
+    PublishQueueElement *tmp;
+    // There are as many slots as the queue can hold, so once we got a slot the queue has room for it
+    if (index != 0 || len != total) {
+        tmp = _messagePool.assemble(topicCharPtr, payloadCharPtr, properties, len, index, total, 20 / portTICK_PERIOD_MS);
+        if (!tmp)
+            return;  // Waiting for more parts, or the message was dropped
+    } else {
+        size_t topicLen = strlen(topicCharPtr);
+        if (!_messagePool.fits(topicLen, len)) {
+            log_e("Dropping message on topic '%s', topic or payload (%d) is too long", topicCharPtr, len);
+            return;
+        }
 
-    char *topic = new char[strlen(topicCharPtr) + 1];
-    strcpy(topic, topicCharPtr);
+        tmp = _messagePool.acquire(20 / portTICK_PERIOD_MS);
+        if (!tmp) {
+            log_e("Dropping message on topic '%s', no free message slot", topicCharPtr);
+            return;
+        }
 
-    PublishQueueElement *tmp = new PublishQueueElement;
-    tmp->topic = topic;
-    tmp->payload = payload;
-    tmp->mqttProps = properties;
+        memcpy(tmp->topic, topicCharPtr, topicLen + 1);
+        memcpy(tmp->payload, payloadCharPtr, len);
+        tmp->payload[len] = '\0';
+        tmp->payloadLen = len;
+        tmp->mqttProps = properties;
+    }
 
-    log_v("New Message on topic: '%s' with payload: '%s' len %d total %d lenin %d lenout %d retain %d", topic, payload, len, total, strlen(payloadCharPtr), strlen(payload), properties.retain);
-    xQueueSendToBack(_newMqttMessageQueue, &tmp, 20 / portTICK_PERIOD_MS);
+    log_v("New Message on topic: '%s' with payload: '%s' len %d retain %d", tmp->topic, tmp->payload, tmp->payloadLen, properties.retain);
+    xQueueSendToBack(_newMqttMessageQueue, &tmp, 0);
 }
 
-void Device::restoreRetainedProperties() {
-    //Wait for the msgs to come in!
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    std::map<Property *, PublishQueueElement *> receivedValues;  //from normal property topic
-    std::map<Property *, PublishQueueElement *> commandValues;   //from SET topic
+void Device::applyRestoredValue(Property &property, const char *payload) {
+    PropertySetCallback callback = property.getCallback();
+    if (callback == nullptr) {
+        property.setValue(payload);
+    } else {
+        String v = callback(property, payload);
+        property.setValue(v);
+    }
+}
 
+bool Device::restoreRetainedProperties(uint32_t connection) {
     unsigned long stamp = millis();
+    char topic[HOMIE_MAX_TOPIC_LEN + 1];
+
+    // Every retained property still waiting for its DATA channel expects one retained message
+    size_t expected = 0;
+    _topicIndex.forEach(TOPIC_DATA, [&expected](Property &) { expected++; });
 
     log_i("---------------------------------------");
-    log_i("Restoring retained properties... STARTED");
-    log_i("Working off received Messages, splitting them into REC_MAP and CMD_MAP");
+    log_i("Restoring retained properties... STARTED, expecting up to %d values", expected);
     log_i("---------------------------------------");
 
-    PublishQueueElement *elm;
-    while (xQueueReceive(_newMqttMessageQueue, &elm, 0)) {
-        std::map<const char *, Property *>::iterator it = _topicCallbacks.find(elm->topic);
+    // MQTT keeps the order of messages on a connection, the broker sends the retained messages of all
+    // earlier subscriptions before it delivers the sentinel back to us. So once it arrives the burst is over.
+    char nonce[12];
+    snprintf(nonce, sizeof(nonce), "%u", ++_restoreRound);
+    _client.subscribe(_sentinelTopic, 1);
+    _client.publish(_sentinelTopic, 1, false, nonce);
+
+    size_t restored = 0;
+    bool sentinelReceived = false;
+    while (!sentinelReceived && restored < expected) {
+        // The next connection restores again, its messages arent ours to take
+        if (connection != __atomic_load_n(&_connection, __ATOMIC_ACQUIRE)) {
+            log_w("Restore gave up, the connection was lost after %d of %d values", restored, expected);
+            return false;
+        }
 
-        if (it != _topicCallbacks.end()) {
-            Property *p = it->second;
-            // If Property is not retained we should not check for some retained/default values
-            if (p == nullptr || !p->isRetained()) {
-                delete elm;
-                continue;
-            }
-            // Is it normal DATA channel!
-            if (strcmp(elm->topic + (strlen(elm->topic) - 4), "/set") != 0) {
-                //Restored from last State
-                receivedValues[p] = elm;
-            } else {
-                //Comes from SET Channel
-                if (elm->mqttProps.retain) {
-                    // Message was retained, ignoring all retained msgs in SET CHANNEL! As per Homie Spec!
-                    delete elm;
-                } else {
-                    commandValues[p] = elm;
-                }
-            }
+        unsigned long elapsed = millis() - stamp;
+        if (elapsed >= HOMIE_RESTORE_TIMEOUT_MS) {
+            log_w("Restore timed out after %d ms, %d of %d values received", elapsed, restored, expected);
+            break;
         }
-    }
 
-    log_i("---------------------------------------");
-    log_i("Working off values in REC_MAP, or use value in CMD_MAP if present.");
-    log_i("REC_MAP-CNT: %d", receivedValues.size());
-    log_i("---------------------------------------");
-    auto tmpRec = receivedValues;  //Create a copy to be used!!!
-    for (std::map<Property *, PublishQueueElement *>::iterator it = tmpRec.begin(); it != tmpRec.end(); it++) {
-        Property *p = it->first;
-        bool comesFromCommand = false;
-        if (p->isSettable()) {
-            // Check if we have a command value for this property, so we can use it instead of the restored data value!
-            if (commandValues.count(p) > 0) {
-                elm = commandValues[p];
-                commandValues.erase(p);
-                comesFromCommand = true;
-                log_v("COMMAND CHANNEL FOR: Property %s with CMD-Value '%s' DATA-Value '%s'", p->getName(), elm->payload, it->second->payload);
-            } else {
-                elm = it->second;
-                log_v("DATA CHANNEL FOR: Property %s with Topic %s.", p->getName(), p->getTopic());
-            }
-        } else {
-            elm = it->second;
+        PublishQueueElement *elm;
+        if (!xQueueReceive(_newMqttMessageQueue, &elm, pdMS_TO_TICKS(HOMIE_RESTORE_TIMEOUT_MS - elapsed)) || !elm)
+            continue;  // No message is the wake up of a disconnect
+
+        if (strcmp(elm->topic, _sentinelTopic) == 0) {
+            // A sentinel of an earlier attempt doesnt tell anything about our subscriptions
+            sentinelReceived = strcmp(elm->payload, nonce) == 0;
+            _messagePool.release(elm);
+            continue;
         }
 
-        //Only delete the DATA channels from the subscription and topic callbacks, since we dont need them anymore!
-        _topicCallbacks.erase(it->second->topic);
-        _client.unsubscribe(it->second->topic);
-        if (p->isRetained()) {
-            PropertySetCallback callback = p->getCallback();
-            if (callback == nullptr) {
-                p->setValue(elm->payload);
+        TopicChannel channel;
+        Property *p = _topicIndex.find(elm->topic, &channel);
+        // Retained messages in the SET channel are ignored, as per Homie Spec!
+        if (p != nullptr && p->isRetained() && (channel == TOPIC_DATA || !elm->mqttProps.retain)) {
+            // A command wins over the retained value, so the DATA channel is done with either of them
+            if (channel == TOPIC_DATA || _topicIndex.has(*p, TOPIC_DATA)) {
+                _topicIndex.remove(*p, TOPIC_DATA);
+                if (_subscribeMode == SUBSCRIBE_PER_TOPIC)
+                    _client.unsubscribe(p->getTopic(topic));
+                restored++;
+            }
+            if (channel == TOPIC_DATA && _lastValues.isNewer(*p)) {
+                // Set while the broker couldnt get it, so it is newer than the retained value
+                log_v("Keeping value '%s' of Property %s over the retained value '%s'", p->getValue(), p->getName(),
+                      elm->payload);
+                _publishScheduler.publish(*p);
+            } else if (channel == TOPIC_DATA && _lastValues.isLoaded(*p) && strcmp(p->getValue(), elm->payload) == 0) {
+                // The loaded value is the retained one, its callback already ran
+                _lastValues.published(*p);
             } else {
-                String v = callback(*p, elm->payload);
-                p->setValue(v);
+                log_v("Restoring Property %s from %s channel with value '%s'", p->getName(),
+                      channel == TOPIC_DATA ? "DATA" : "COMMAND", elm->payload);
+                applyRestoredValue(*p, elm->payload);
             }
+        } else if (p == nullptr) {
+            MqttLogger::handleMessage(elm->topic, elm->payload);
         }
-        vTaskDelay(pdMS_TO_TICKS(40));
-
-        if (comesFromCommand)
-            delete elm;
-        delete it->second;
+        _messagePool.release(elm);
     }
+    _client.unsubscribe(_sentinelTopic);
+    unsubscribeRestoreFilters();
 
-    // Think about basically ignoring/just deleting stuff in commandValues, since returendValues should be more present than Command channel!
-    auto tmpCommand = commandValues;
     log_i("---------------------------------------");
-    log_i("Working off left overs in CMD_MAP!");
-    log_i("CMD_MAP-CNT: %d", commandValues.size());
+    log_i("Restored %d of %d values", restored, expected);
     log_i("---------------------------------------");
-    for (std::map<Property *, PublishQueueElement *>::iterator it = tmpCommand.begin(); it != tmpCommand.end(); it++) {
-        Property *p = it->first;
-        log_i("LeftOver: Property %s with Topic %s.", p->getName(), p->getTopic());
-        elm = it->second;
-
-        _topicCallbacks.erase(p->getTopic());
-        _client.unsubscribe(p->getTopic());
-
-        PropertySetCallback callback = p->getCallback();
-        if (callback == nullptr) {
-            p->setValue(elm->payload);
-        } else {
-            String v = callback(*p, elm->payload);
-            p->setValue(v);
-        }
-        vTaskDelay(pdMS_TO_TICKS(40));
-        delete elm;
-    }
 
     if (!_setupDone) {
-        auto tmp = _topicCallbacks;
         log_i("---------------------------------------");
         log_i("Handling default value for properties");
         log_i("---------------------------------------");
-        for (auto valuePair : tmp) {
-            Property *p = valuePair.second;
-            const char *topic = valuePair.first;
-            // Check if its a DATA channel!!
-            if (strcmp(topic + (strlen(topic) - 4), "/set") != 0) {
-                if (p == nullptr || !p->getName() || !p->getId()) {
-                    log_v("Property for Topic had sth. empty %s", topic);
-                    continue;
-                }
-
-                log_i("Didnt receive a default for %s(%s) with topic: %s onTopic: %s", p->getName(),
-                      p->getId(), p->getTopic(), topic);
-                _client.unsubscribe(p->getTopic());
-
-                if (p->isRetained()) {
-                    PropertySetCallback callback = p->getCallback();
+        // Only the DATA channels that didnt receive a retained value are still registered
+        _topicIndex.forEach(TOPIC_DATA, [this, &topic](Property &prop) {
+            Property *p = &prop;
+            if (!p->getName() || !p->getId()) {
+                log_v("Property for Topic had sth. empty %s", p->getTopic(topic));
+                return;
+            }
 
-                    const char *providedVal = p->getValue();
+            log_i("Didnt receive a default for %s(%s) with topic: %s", p->getName(),
+                  p->getId(), p->getTopic(topic));
+            if (_subscribeMode == SUBSCRIBE_PER_TOPIC)
+                _client.unsubscribe(p->getTopic(topic));
 
-                    if (!p->validateValue(providedVal)) {
-                        providedVal = defaultForDataType(p->getDataType());
-                    }
+            if (_lastValues.isLoaded(*p)) {
+                // The broker doesnt know the loaded value, its callback already ran
+                _publishScheduler.publish(*p);
+            } else if (p->isRetained()) {
+                const char *providedVal = p->getValue();
 
-                    if (callback == nullptr) {
-                        p->setValue(providedVal);
-                    } else {
-                        String v = callback(*p, providedVal);
-                        p->setValue(v);
-                    }
+                if (!p->validateValue(providedVal)) {
+                    providedVal = defaultForDataType(p->getDataType());
                 }
-                _topicCallbacks.erase(topic);
-                vTaskDelay(pdMS_TO_TICKS(40));
+                applyRestoredValue(*p, providedVal);
             }
-        }
-        vTaskDelay(pdMS_TO_TICKS(500));
+            _topicIndex.remove(*p, TOPIC_DATA);
+        });
 
         log_i("---------------------------------------");
         log_i("Defaults handling... DONE");
         log_i("---------------------------------------");
         _setupDone = true;
-        setState(DSTATE_READY);
-        for (auto callback : _onDeviceSetupDoneCallbacks)
-            callback(*this);
-    } else {
-        vTaskDelay(pdMS_TO_TICKS(500));
-        setState(DSTATE_READY);
+        _lastValues.startTracking();
+        // Everything the model needs is allocated now, its footprint stays as it is
+        _arena.seal();
     }
-    _client.publish(prefixedTopic(_workingBuffer, "$state"), 1, true, stateEnumToString(_state));
+
+    _restoreDone = true;
+    _restoreDuration = millis() - stamp;
     log_i("---------------------------------------");
-    log_i("Restoring retained properties... DONE took %d ms", (millis() - stamp));
+    log_i("Restoring retained properties... DONE took %d ms", _restoreDuration);
     log_i("---------------------------------------");
+    return true;
 }
 
 void Device::onMqttConnectCallback(bool sessionPresent) {
-    log_i("MQTT Connected - Starting Device Init/Setup");
+    log_i("MQTT Connected - Starting Device Init/Setup, session present: %d", sessionPresent);
+    _sessionPresent = sessionPresent;
     _connectionTimeStamp = millis();
     _mqttReconnectAttempts = 0;
     xTaskCreateUniversal(
@@ -442,9 +566,16 @@ void Device::onMqttConnectCallback(bool sessionPresent) {
 
 void Device::onMqttDisconnectCallback(AsyncMqttClientDisconnectReason reason) {
     log_e("Lost MQTT connection reason: %d", reason);
+    xSemaphoreTake(_connectionLock, portMAX_DELAY);
+    __atomic_add_fetch(&_connection, 1, __ATOMIC_RELEASE);
     setState(DSTATE_LOST);
+    _publishScheduler.hold();
     vTaskSuspend(_taskStatsHandling);
     vTaskSuspend(_taskNewMqttMessages);
+    xSemaphoreGive(_connectionLock);
+    // Wakes a restore waiting for a message, it gives up
+    PublishQueueElement *wake = nullptr;
+    xQueueSendToBack(_newMqttMessageQueue, &wake, 0);
     if (WiFi.isConnected()) {
         log_i("Starting Timer");
         uint32_t delay = min(
@@ -469,6 +600,7 @@ void Device::onDeviceSetupDoneCallback(OnDeviceSetupDoneCallback callback) {
 
 void Device::startInitOrSetupTaskCode(void *parameter) {
     Device *crntDevice = (Device *)parameter;
+    uint32_t connection = __atomic_load_n(&crntDevice->_connection, __ATOMIC_ACQUIRE);
     log_i("---------------------------------------");
     log_i("StartOrInit Task running on Core %d name %s", xPortGetCoreID(), pcTaskGetTaskName(nullptr));
     log_i("---------------------------------------");
@@ -479,16 +611,33 @@ void Device::startInitOrSetupTaskCode(void *parameter) {
         vTaskDelete(nullptr);
     }
 
-    // After a restart of the broker its a bad idea to publish to fast!
-
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    xSemaphoreTake(crntDevice->_initLock, portMAX_DELAY);
+    if (connection != crntDevice->_connection) {
+        log_i("startInitOrSetupTask, the connection was lost before the init started");
+        xSemaphoreGive(crntDevice->_initLock);
+        vTaskDelete(nullptr);
+    }
 
     log_i("---------------------------------------");
     log_i("Device setup/init... STARTED");
     log_i("---------------------------------------");
     unsigned long stamp = millis();
     vTaskSuspend(crntDevice->_taskNewMqttMessages);
+    // Values set meanwhile are published once the device and the broker agree again
+    crntDevice->_publishScheduler.hold();
+
+    if (crntDevice->_setupDone && crntDevice->_persistentSession && crntDevice->_sessionPresent &&
+        crntDevice->_restoreDone) {
+        crntDevice->resume();
+        crntDevice->becomeReady(connection);
+        log_i("---------------------------------------");
+        log_i("Device resume... DONE took %d ms", (millis() - stamp));
+        log_i("---------------------------------------");
+        xSemaphoreGive(crntDevice->_initLock);
+        vTaskDelete(nullptr);
+    }
 
+    crntDevice->_restoreDone = false;
     if (crntDevice->_setupDone) {
         crntDevice->init();
         log_i("---------------------------------------");
@@ -502,14 +651,19 @@ void Device::startInitOrSetupTaskCode(void *parameter) {
     }
     if (crntDevice->getState() == DSTATE_ALERT) {
         log_e("FATAL ERROR CREATING HOMIE DEVICE");
+        xSemaphoreGive(crntDevice->_initLock);
         vTaskDelete(nullptr);
     }
     // log_e("Pre: FreeHeap '%d' MinFreeBlock '%d'", xPortGetFreeHeapSize(), xPortGetMinimumEverFreeHeapSize());
-    crntDevice->restoreRetainedProperties();
+    // Commands received before the disconnect are done before the restore sets the same properties,
+    // a callback that doesnt return holds the restore up for HOMIE_CALLBACK_IDLE_TIMEOUT_MS at most
+    crntDevice->_callbackDispatcher.waitIdle();
+    // A restore or init of a lost connection leaves the device to the init task of the next one
+    if (crntDevice->restoreRetainedProperties(connection))
+        crntDevice->becomeReady(connection);
     // log_e("Post: FreeHeap '%d'  MinFreeBlock '%d'", xPortGetFreeHeapSize(), xPortGetMinimumEverFreeHeapSize());
 
-    vTaskResume(crntDevice->_taskNewMqttMessages);
-    vTaskResume(crntDevice->_taskStatsHandling);
+    xSemaphoreGive(crntDevice->_initLock);
     vTaskDelete(nullptr);
 }
 
@@ -547,28 +701,16 @@ void Device::handleIncomingMqttTaskCode(void *parameter) {
     Device *crntDevice = (Device *)parameter;
     for (;;) {
         PublishQueueElement *elm = nullptr;
-        if (xQueueReceive(crntDevice->_newMqttMessageQueue, &elm, portMAX_DELAY)) {
+        if (xQueueReceive(crntDevice->_newMqttMessageQueue, &elm, portMAX_DELAY) && elm) {
             const char *tPtr = elm->topic;
-            auto it = crntDevice->_topicCallbacks.find(tPtr);
-            log_i("MQTT: topic: '%s' payload '%s'", tPtr, elm->payload);
-            if (it != crntDevice->_topicCallbacks.end()) {
-                Property *p = it->second;
-                
-                // Add check to prevent processing our own published values
-                if (strcmp(p->getValue(), elm->payload) != 0) {
-                log_v("Found a matching callback for topic '%s' property: %s(%s)", tPtr,
-                      p->getName(), p->getId());
-
-                PropertySetCallback callback = p->getCallback();
-                if (callback == nullptr) {
-                    p->setValue(elm->payload);
-                } else {
-                    String v = callback(*p, elm->payload);
-                    p->setValue(v);
-                }
-            }
+            Property *p = crntDevice->_topicIndex.find(tPtr);
+            log_d("MQTT: topic: '%s' payload '%s'", tPtr, elm->payload);
+            if (p == nullptr) {
+                MqttLogger::handleMessage(tPtr, elm->payload);
+                crntDevice->_messagePool.release(elm);
+            } else {
+                crntDevice->_callbackDispatcher.dispatch(*p, elm);
             }
-            delete elm;
         }
     }
 }
@@ -618,8 +760,9 @@ void Device::onWiFiEventCallback(WiFiEvent_t event) {
 }
 
 Stats &Device::addStats(const char *id, GetStatsFunction fnc) {
-    Stats &s = *new Stats(*this, _client, id);
+    Stats &s = *_arena.create<Stats>(*this, _client, id);
     _stats.push_back(&s);
+    _statsPayload = nullptr;
     s.setFunc(fnc);
     if (_stats.size() == 1 && _state == DSTATE_READY) {
         vTaskResume(_taskStatsHandling);
@@ -5,12 +5,21 @@
 #include <WString.h>
 #include <WiFi.h>
 
+#include <CallbackDispatcher.hpp>
 #include <HomieState.hpp>
+#include <IdList.hpp>
+#include <LastValueCache.hpp>
+#include <MessagePool.hpp>
+#include <ModelArena.hpp>
 #include <Node.hpp>
+#include <PublishScheduler.hpp>
 #include <Stats.hpp>
+#include <TopicBuilder.hpp>
+#include <TopicIndex.hpp>
 #include <map>
 #include <vector>
 
+#undef TAG
 #define TAG "Home_Device"
 
 #define HOMIE_VER "3.0.1"
@@ -18,6 +27,11 @@
 #define HOMIE_INCOMING_MSG_QUEUE 50
 #endif
 
+// Upper bound for waiting on the retained values after (re)connecting
+#ifndef HOMIE_RESTORE_TIMEOUT_MS
+#define HOMIE_RESTORE_TIMEOUT_MS 5000
+#endif
+
 #ifndef CONFIG_HOMIE_INCOMING_RUNNING_CORE
 #define CONFIG_HOMIE_INCOMING_RUNNING_CORE -1
 #endif
@@ -26,28 +40,16 @@
 #define CONFIG_HOMIE_STATS_RUNNING_CORE -1
 #endif
 
+// How the device subscribes to the topics of its properties
+typedef enum {
+    SUBSCRIBE_PER_TOPIC = 0,  // homie/<id>/<node>/<property>/set for every settable property
+    SUBSCRIBE_PER_NODE = 1,   // homie/<id>/<node>/+/set for every node with a settable property
+    SUBSCRIBE_WILDCARD = 2    // homie/<id>/+/+/set once for the whole device
+} HomieSubscribeMode;
+
 typedef std::function<void(HomieDeviceState state)> OnDeviceStateChangedCallback;
 typedef std::function<void(Device &device)> OnDeviceSetupDoneCallback;
 
-struct CmpStr {
-    bool operator()(char const *a, char const *b) const {
-        //log_v("Comparing: a:'%s' b:'%s' result: %d", a, b, strcmp(a, b));
-        return strcmp(a, b) < 0;
-    }
-};
-
-struct PublishQueueElement {
-    const char *topic;
-    const char *payload;
-    AsyncMqttClientMessageProperties mqttProps;
-
-    ~PublishQueueElement() {
-        // log_v("Destructor of PupQueElm");
-        delete[] topic;
-        delete[] payload;
-    }
-};
-
 struct TimerArguments {
     Device *device;
 };
@@ -63,24 +65,49 @@ class Device {
 
     const char *_topic;
     const char *_lwTopic;
+    const char *_sentinelTopic;
     const char *_homieVersion;
     const char *_id;
     const char *_name;
     const char *_mac;
     const char *_extensions;
+    // Payloads of $nodes and $stats, built in the arena at the first setup
+    const char *_nodesPayload = nullptr;
+    const char *_statsPayload = nullptr;
 
     bool _setupDone = false;
+    bool _persistentSession = false;
+    bool _sessionPresent = false;
+    // Cleared while (re)subscribing and restoring, only a session that got that far can be resumed
+    bool _restoreDone = false;
+    bool _setupAnnounced = false;
+    // Counts the disconnects, an init task that started before the last one is stale
+    volatile uint32_t _connection = 0;
+    // Orders becoming ready against a disconnect
+    SemaphoreHandle_t _connectionLock;
+    // One init task at a time, a newer one waits until a stale one gave up
+    SemaphoreHandle_t _initLock;
 
     int _statsInterval = 60;
 
-    char *_workingBuffer;
+    size_t _maxTopicLen = 0;
+    // QoS of the $ attribute publishes of the device, its nodes and properties
+    uint8_t _attributeQos = 1;
+    HomieSubscribeMode _subscribeMode = SUBSCRIBE_PER_TOPIC;
     unsigned long _connectionTimeStamp;
+    unsigned long _restoreDuration = 0;
+    uint32_t _restoreRound = 0;
 
-    std::map<const char *, Property *, CmpStr> _topicCallbacks;
+    ModelArena _arena;
+    TopicIndex _topicIndex;
     std::vector<OnDeviceStateChangedCallback> _onDeviceStateChangedCallbacks;
     std::vector<OnDeviceSetupDoneCallback> _onDeviceSetupDoneCallbacks;
 
     QueueHandle_t _newMqttMessageQueue;
+    MessagePool _messagePool;
+    CallbackDispatcher _callbackDispatcher;
+    PublishScheduler _publishScheduler;
+    LastValueCache _lastValues;
 
     TaskHandle_t _taskStatsHandling;
     TaskHandle_t _taskNewMqttMessages;
@@ -93,8 +120,6 @@ class Device {
     unsigned long _mqttReconnectAttempts = 0;
     const unsigned long MAX_RECONNECT_DELAY = 300000; // 5 minutes
 
-    void restoreRetainedProperties();
-
     static void startInitOrSetupTaskCode(void *parameter);
 
     static void handleIncomingMqttTaskCode(void *parameter);
@@ -111,16 +136,40 @@ class Device {
 
     void onWiFiEventCallback(WiFiEvent_t event);
 
+    void applyRestoredValue(Property &property, const char *payload);
+
+    // Restores the values for the connection the init task started on
+    bool restoreRetainedProperties(uint32_t connection);
+
+    // Sets $state ready and lets the incoming, stats and publish tasks go, unless the connection was lost meanwhile
+    bool becomeReady(uint32_t connection);
+
+    // Builds the topic index, which numbers the properties. Nodes and properties added later arent indexed.
+    bool freezeModel();
+
+    size_t computeMaxTopicLength();
+
+    void subscribeWildcard();
+
+    void unsubscribeRestoreFilters();
+
    public:
-    Device(AsyncMqttClient &client, const char *id, uint8_t buffSize = 128);
+    Device(AsyncMqttClient &client, const char *id);
+
+    /**
+     * @brief Kept for sketches that pass the size of the former shared working buffer, buffSize is ignored.
+     * Topics are composed in buffers of the longest topic of the device now.
+     */
+    __attribute__((deprecated("buffSize is ignored, use Device(client, id)")))
+    Device(AsyncMqttClient &client, const char *id, uint8_t buffSize) : Device(client, id) {}
 
     ~Device() {
         for (auto &&node : _nodes) {
-            delete node;
+            _arena.destroy(node);
         }
 
         for (auto &&stat : _stats) {
-            delete stat;
+            _arena.destroy(stat);
         }
     }
     /**
@@ -141,6 +190,23 @@ class Device {
      */
     Node &addNode(const char *id, const char *name, const char *type);
 
+    /**
+     * @brief Adds a Node declared with HOMIE_DECLARE_NODE, together with its properties.
+     * The names, ids and topics are used from the declaration, nothing is copied.
+     *
+     * @param spec the declaration
+     * @return Node& the created Node
+     */
+    Node &addNode(const HomieNodeSpec &spec);
+
+    /**
+     * @brief Adds a Node to the device
+     *
+     * @param node the Node to add
+     * @return Node& the Node added
+     */
+    Node &addNode(Node &node);
+
     /**
      * @brief Allocates and adds a new Stats Object to the device.
      * 
@@ -150,6 +216,27 @@ class Device {
      */
     Stats &addStats(const char *id, GetStatsFunction fnc);
 
+    /**
+     * @brief Keeps the values of the settable retained properties in store, e.g. a NvsValueStore, and loads
+     * the values stored before the last reboot right away. Their callbacks are called and the values are
+     * set as defaults, so outputs are in their last state without waiting for the broker.
+     * Has to be called once all nodes, properties, defaults and callbacks are in place and before the
+     * device connects. The retained value of the broker only wins if the stored value reached it.
+     *
+     * @param store has to live as long as the device
+     * @return false if the store couldnt be opened
+     */
+    bool setLastValueStore(LastValueStore &store);
+
+    /**
+     * @brief Get the cache of the last values, e.g. for its counters or to write the changed values now
+     *
+     * @return LastValueCache&
+     */
+    LastValueCache &getLastValueCache() {
+        return this->_lastValues;
+    }
+
     /**
      * @brief Sets up the Device
      * The Setup will only be called once. 
@@ -163,6 +250,26 @@ class Device {
      */
     void init();
 
+    /**
+     * @brief Resumes the Device after a reconnect on which the broker still had our session.
+     * The subscriptions are kept by the broker and the values are already restored,
+     * so only $localip is published. Becoming ready publishes $state and the values set while offline.
+     */
+    void resume();
+
+    /**
+     * @brief Restores the retained Property values received after setup/init.
+     * Will be called by the setup/init task, once the properties subscribed to their topics.
+     * Values are applied as they arrive, the restore ends once all expected values arrived
+     * or a sentinel published to debug/<id>/restore came back, at the latest after HOMIE_RESTORE_TIMEOUT_MS.
+     * It gives up as soon as the connection is lost.
+     *
+     * @return false if the connection was lost before the restore was done
+     */
+    bool restoreRetainedProperties() {
+        return restoreRetainedProperties(_connection);
+    }
+
     /**
      * @brief Registers a settable Property.
      * Basically makes sure thath incomming MQTT Msgs can be mapped to the correct Propety.
@@ -170,6 +277,13 @@ class Device {
      */
     void registerSettableProperty(Property &property);
 
+    /**
+     * @brief Registers all settable Properties of a node in one pass.
+     * Called by Node::init() before the properties subscribe to their topics.
+     * @param node
+     */
+    void registerSettableProperties(Node &node);
+
     /**
      * @brief Adds a new OnDeviceStatChangedCallback to the Callback.
      * These callbacks will be called when ever the device state changes.
@@ -187,19 +301,6 @@ class Device {
      */
     void onDeviceSetupDoneCallback(OnDeviceSetupDoneCallback callback);
 
-    /**
-     * @brief extends a "topic" with the baseTopic of this Device
-     * Example: 
-     * BaseTopic = "homie/lamp-v2-dev/"
-     * d = "$stats/interval"
-     * returns -> "homie/lamp-v2-dev/$stats/interval"
-     * 
-     * @param buff The char* buffer to work on
-     * @param d * the extension String.
-     * @return char* 
-     */
-    char *prefixedTopic(char *buff, const char *d);
-
     /**
      * @brief Get the State object
      * 
@@ -226,12 +327,7 @@ class Device {
      * @param name 
      */
     void setName(const char *name) {
-        if (_name)
-            delete[] _name;
-
-        char *_namebuff = new char[strlen(name) + 1];
-        strcpy(_namebuff, name);
-        _name = _namebuff;
+        this->_name = this->_arena.intern(name);
     }
 
     /**
@@ -244,12 +340,89 @@ class Device {
     }
 
     /**
-     * @brief Get the Working Buffer object
-     * 
-     * @return char* 
+     * @brief Length of the longest topic the device publishes its attributes to,
+     * known after setup. Used to size the TopicBuilders.
+     *
+     * @return size_t
+     */
+    size_t getMaxTopicLength() {
+        return this->_maxTopicLen;
+    }
+
+    /**
+     * @brief Number of properties of all nodes, known after setup. Their indices are 0 .. getPropertyCount() - 1.
+     */
+    uint16_t getPropertyCount() {
+        return this->_topicIndex.size();
+    }
+
+    /**
+     * @brief Get a Property by its index (Property::getIndex()), e.g. to keep state for every property in a flat array.
+     *
+     * @return Property* nullptr before setup or if there is no such property
+     */
+    Property *getProperty(uint16_t index) {
+        return this->_topicIndex.get(index);
+    }
+
+    /**
+     * @brief Get the arena the nodes, properties and stats are allocated from, e.g. for its footprint.
+     * It is sealed once the device is set up.
+     *
+     * @return ModelArena&
      */
-    char *getWorkingBuffer() {
-        return this->_workingBuffer;
+    ModelArena &getArena() {
+        return this->_arena;
+    }
+
+    /**
+     * @brief Get the pool holding the incoming MQTT messages, e.g. for its counters
+     *
+     * @return MessagePool&
+     */
+    MessagePool &getMessagePool() {
+        return this->_messagePool;
+    }
+
+    /**
+     * @brief Get the scheduler publishing the property values
+     *
+     * @return PublishScheduler&
+     */
+    PublishScheduler &getPublishScheduler() {
+        return this->_publishScheduler;
+    }
+
+    /**
+     * @brief Get the CallbackDispatcher, e.g. for the queue depth and latency of its lanes
+     *
+     * @return CallbackDispatcher&
+     */
+    CallbackDispatcher &getCallbackDispatcher() {
+        return this->_callbackDispatcher;
+    }
+
+    /**
+     * @brief Set the number of worker tasks running the set callbacks, has to be called before the device connects.
+     *
+     * @param lanes 0 runs the callbacks on the incoming task, one after the other
+     */
+    bool setCallbackLanes(uint8_t lanes) {
+        return this->_callbackDispatcher.setLaneCount(lanes);
+    }
+
+    /**
+     * @brief Limits how many property values are published per second, across all properties.
+     * Values set faster than that are coalesced, only the latest value of a property is published.
+     *
+     * @param publishesPerSecond 0 disables the limit
+     */
+    void setPublishRateLimit(uint16_t publishesPerSecond) {
+        this->_publishScheduler.setRateLimit(publishesPerSecond);
+    }
+
+    uint16_t getPublishRateLimit() {
+        return this->_publishScheduler.getRateLimit();
     }
 
     /**
@@ -261,6 +434,15 @@ class Device {
         return this->_connectionTimeStamp;
     }
 
+    /**
+     * @brief Time the last restore of the retained values took, also published as $stats/restoretime
+     *
+     * @return unsigned long in ms
+     */
+    unsigned long getRestoreDuration() {
+        return this->_restoreDuration;
+    }
+
     /**
      * @brief IsSetupDone
      * 
@@ -271,6 +453,45 @@ class Device {
         return this->_setupDone;
     }
 
+    /**
+     * @brief Set the QoS of the attribute publishes ($name, $datatype, ...) of the device, its nodes and properties.
+     * $state stays at QoS 1, like the last will.
+     */
+    void setAttributeQos(uint8_t qos) {
+        this->_attributeQos = qos > 2 ? 2 : qos;
+    }
+
+    uint8_t getAttributeQos() {
+        return this->_attributeQos;
+    }
+
+    /**
+     * @brief Connect with a persistent session (clean session off), has to be called before the device connects.
+     * If the broker still has the session after a reconnect, e.g. after a short WiFi drop, the device skips
+     * resubscribing and restoring and is ready right away. The client id has to stay the same across reconnects.
+     */
+    void setPersistentSession(bool persistent) {
+        this->_persistentSession = persistent;
+        this->_client.setCleanSession(!persistent);
+    }
+
+    bool isPersistentSession() {
+        return this->_persistentSession;
+    }
+
+    /**
+     * @brief Set how the properties subscribe to their topics, has to be called before the device connects.
+     * With SUBSCRIBE_PER_NODE and SUBSCRIBE_WILDCARD the retained values are restored through a
+     * "<node>/+" resp. "+/+" filter as well, messages for other topics are dropped through the topic index.
+     */
+    void setSubscribeMode(HomieSubscribeMode mode) {
+        this->_subscribeMode = mode;
+    }
+
+    HomieSubscribeMode getSubscribeMode() {
+        return this->_subscribeMode;
+    }
+
     /**
      * @brief Set the Stats Interval
      * 
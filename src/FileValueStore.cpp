@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <FileValueStore.hpp>
+#include "MqttLogger.hpp"
+
+// A record is <key length:1><key><data length:2, little endian><data>
+
+bool FileValueStore::begin() {
+    _records.clear();
+    std::string path = _path;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        // A reset between removing the old file and renaming the new one, see commit()
+        path = _path + ".tmp";
+        file = fopen(path.c_str(), "rb");
+    }
+    if (!file)
+        return true;  // Nothing stored yet
+
+    for (;;) {
+        int keyLen = fgetc(file);
+        if (keyLen == EOF)
+            break;
+
+        std::string key(keyLen, '\0');
+        uint8_t len[2];
+        if (fread(&key[0], 1, keyLen, file) != (size_t)keyLen || fread(len, 1, 2, file) != 2) {
+            log_e("Last value file '%s' is truncated, %d records read", path.c_str(), _records.size());
+            break;
+        }
+
+        std::string data(len[0] | len[1] << 8, '\0');
+        if (!data.empty() && fread(&data[0], 1, data.size(), file) != data.size()) {
+            log_e("Last value file '%s' is truncated, %d records read", path.c_str(), _records.size());
+            break;
+        }
+        _records[key] = data;
+    }
+    fclose(file);
+    return true;
+}
+
+size_t FileValueStore::read(const char *key, void *buff, size_t size) {
+    auto record = _records.find(key);
+    if (record == _records.end() || record->second.size() > size)
+        return 0;
+    memcpy(buff, record->second.data(), record->second.size());
+    return record->second.size();
+}
+
+bool FileValueStore::write(const char *key, const void *data, size_t len) {
+    if (strlen(key) > UINT8_MAX || len > UINT16_MAX)
+        return false;
+
+    _dirty = true;
+    _records[key].assign((const char *)data, len);
+    return true;
+}
+
+bool FileValueStore::commit() {
+    if (!_dirty)
+        return true;
+
+    std::string tmpPath = _path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        log_e("Unable to write last value file '%s'", tmpPath.c_str());
+        return false;
+    }
+
+    bool ok = true;
+    for (auto const &record : _records) {
+        const std::string &key = record.first;
+        const std::string &data = record.second;
+        uint8_t len[2] = {(uint8_t)data.size(), (uint8_t)(data.size() >> 8)};
+        ok &= fputc((int)key.size(), file) != EOF;
+        ok &= fwrite(key.data(), 1, key.size(), file) == key.size();
+        ok &= fwrite(len, 1, 2, file) == 2;
+        ok &= fwrite(data.data(), 1, data.size(), file) == data.size();
+    }
+    ok &= fclose(file) == 0;
+    if (!ok) {
+        log_e("Unable to write last value file '%s'", tmpPath.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    // SPIFFS doesnt rename over an existing file, there the old one is removed first
+    if (rename(tmpPath.c_str(), _path.c_str()) != 0 &&
+        (remove(_path.c_str()) != 0 || rename(tmpPath.c_str(), _path.c_str()) != 0)) {
+        log_e("Unable to replace last value file '%s'", _path.c_str());
+        return false;
+    }
+    _dirty = false;
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <LastValueStore.hpp>
+
+/**
+ * @brief Keeps the last values in a file, e.g. on the host or on a mounted SPIFFS/LittleFS.
+ * The records are read once by begin() and kept in memory, every commit() writes the
+ * file anew next to it and renames it over the old one, so a reset while writing
+ * leaves the previous file intact. Where renaming over a file fails, like on SPIFFS,
+ * the old one is removed first and begin() reads the new one if the reset came in between.
+ *
+ * FileValueStore store("/spiffs/homie.values");
+ * device.setLastValueStore(store);
+ */
+class FileValueStore : public LastValueStore {
+   private:
+    std::string _path;
+    // Key to record
+    std::map<std::string, std::string> _records;
+    bool _dirty = false;
+
+   public:
+    FileValueStore(const char *path) : _path(path) {}
+
+    bool begin() override;
+
+    size_t read(const char *key, void *buff, size_t size) override;
+
+    bool write(const char *key, const void *data, size_t len) override;
+
+    bool commit() override;
+};
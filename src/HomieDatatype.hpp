@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 typedef enum {
     HOMIE_UNDEFINED,
     HOMIE_STRING,
@@ -10,4 +12,20 @@ typedef enum {
     HOMIE_BOOLEAN = HOMIE_BOOL,
     HOMIE_ENUM,
     HOMIE_COLOR,
-} HomieDataType;
\ No newline at end of file
+} HomieDataType;
+
+// Components of a color value, h,s,v for the hsv format and r,g,b for the rgb format
+typedef struct {
+    uint16_t h;
+    uint16_t s;
+    uint16_t v;
+} HomieColor;
+
+// Native form of a value, the member in use depends on the HomieDataType
+typedef union {
+    int64_t intValue;
+    double floatValue;
+    bool boolValue;
+    uint8_t enumIndex;
+    HomieColor colorValue;
+} HomieValue;
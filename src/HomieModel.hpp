@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <HomieDatatype.hpp>
+
+/**
+ * @brief Compile time description of a property, generated by HOMIE_DECLARE_NODE.
+ * All strings are literals, so the tables end up in flash and the Property built
+ * from them points into it instead of holding copies.
+ */
+struct HomiePropertySpec {
+    const char *id;
+    const char *name;
+    HomieDataType dataType;
+    bool settable;
+    bool retained;
+    const char *unit;
+    const char *format;
+    // homie/<device>/<node>/<property> and the same with /set
+    const char *topic;
+    const char *topicSet;
+};
+
+/**
+ * @brief Compile time description of a node and its properties, generated by HOMIE_DECLARE_NODE.
+ */
+struct HomieNodeSpec {
+    const char *id;
+    const char *name;
+    const char *type;
+    // Payload of $properties
+    const char *propertyIds;
+    const HomiePropertySpec *properties;
+    size_t propertyCount;
+};
+
+// Expanded for every property of the list passed to HOMIE_DECLARE_NODE, N is the node topic as literal
+#define HOMIE_PROPERTY_SPEC_(N, id, name, dataType, settable, retained, unit, format) \
+    {#id, name, dataType, settable, retained, unit, format, N #id, N #id "/set"},
+#define HOMIE_PROPERTY_ID_(N, id, ...) "," #id
+
+/**
+ * @brief Declares a node with its properties at compile time, e.g.
+ *
+ * #define LIGHT_PROPERTIES(P, N) \
+ *     P(N, power, "Power", HOMIE_BOOL, true, true, nullptr, nullptr) \
+ *     P(N, brightness, "Brightness", HOMIE_INT, true, true, "%", "0:100")
+ *
+ * HOMIE_DECLARE_NODE(lightNode, "lamp-v2-dev", light, "Light", "light", LIGHT_PROPERTIES);
+ * ...
+ * device.addNode(lightNode);
+ *
+ * Every P(N, id, name, dataType, settable, retained, unit, format) takes string literals (or nullptr for
+ * unit and format), the ids are written without quotes. The device id has to be the one the Device is
+ * constructed with, the generated topics are only used if it matches.
+ */
+#define HOMIE_DECLARE_NODE(var, deviceId, nodeId, name, type, PROPERTIES)                       \
+    static constexpr HomiePropertySpec var##Properties[] = {                                   \
+        PROPERTIES(HOMIE_PROPERTY_SPEC_, "homie/" deviceId "/" #nodeId "/")};                  \
+    static constexpr HomieNodeSpec var = {                                                     \
+        #nodeId, name, type, "" PROPERTIES(HOMIE_PROPERTY_ID_, _) + 1, var##Properties,         \
+        sizeof(var##Properties) / sizeof(var##Properties[0])}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string.h>
+
+#include <vector>
+
+#include <ModelArena.hpp>
+
+/**
+ * @brief Joins the ids of the given items with ',' into a buffer of exactly the needed size,
+ * e.g. the payload of $nodes. The buffer lives in the arena.
+ */
+template <typename T>
+const char *joinIds(const std::vector<T *> &items, ModelArena &arena) {
+    size_t len = items.empty() ? 0 : items.size() - 1;
+    for (auto const &item : items)
+        len += strlen(item->getId());
+
+    char *buff = (char *)arena.allocate(len + 1, 1);
+    char *pos = buff;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (i > 0)
+            *pos++ = ',';
+        size_t idLen = strlen(items[i]->getId());
+        memcpy(pos, items[i]->getId(), idLen);
+        pos += idLen;
+    }
+    *pos = '\0';
+    return buff;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+
+#include <LastValueCache.hpp>
+#include <Node.hpp>
+#include <Property.hpp>
+#include <TopicIndex.hpp>
+
+LastValueCache::LastValueCache() {
+    _wake = xSemaphoreCreateBinary();
+    _flushLock = xSemaphoreCreateMutex();
+}
+
+bool LastValueCache::begin(LastValueStore &store, TopicIndex &index, ModelArena &arena) {
+    if (_store) {
+        log_e("The last value store is already set");
+        return false;
+    }
+    if (!index.isFrozen()) {
+        log_e("The properties have to be indexed before the last values are loaded");
+        return false;
+    }
+    if (!store.begin())
+        return false;
+
+    _index = &index;
+    _count = index.size();
+    _state = arena.allocateArray<uint8_t>(_count);
+    _written = arena.allocateArray<uint32_t>(_count);
+    _store = &store;
+
+    xTaskCreateUniversal(
+        this->writeTaskCode,
+        "homie_last_values",
+        4096,
+        this,
+        1,
+        &_task,
+        CONFIG_HOMIE_LAST_VALUE_RUNNING_CORE);
+    return true;
+}
+
+uint32_t LastValueCache::hash(const char *data, size_t len) {
+    // FNV-1a, 0 is left for "nothing written"
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t)data[i]) * 16777619u;
+    return h ? h : 1;
+}
+
+bool LastValueCache::makeKey(Property &property, char *path, char *key) {
+    int len = snprintf(path, HOMIE_MAX_TOPIC_LEN + 1, "%s/%s", property.getParent().getId(), property.getId());
+    if (len < 0 || len > HOMIE_MAX_TOPIC_LEN)
+        return false;
+
+    // NVS keys are at most 15 chars, the path is part of the record to tell colliding hashes apart
+    snprintf(key, 16, "v%08x", hash(path, len));
+    return true;
+}
+
+uint16_t LastValueCache::indexOf(Property &property) {
+    uint16_t index = property.getIndex();
+    if (!_state || index >= _count || !property.isSettable() || !property.isRetained())
+        return _count;
+    return index;
+}
+
+void LastValueCache::mark(uint16_t index, uint8_t set, uint8_t clear) {
+    uint8_t old = __atomic_load_n(&_state[index], __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&_state[index], &old, (uint8_t)((old & ~clear) | set), true, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED)) {
+    }
+    if ((set & STATE_DIRTY) && !(old & STATE_DIRTY) && !__atomic_exchange_n(&_pending, true, __ATOMIC_ACQ_REL))
+        xSemaphoreGive(_wake);
+}
+
+const char *LastValueCache::read(Property &property, char *buff, bool &published) {
+    uint16_t index = indexOf(property);
+    char path[HOMIE_MAX_TOPIC_LEN + 1];
+    char key[16];
+    if (index == _count || !makeKey(property, path, key))
+        return nullptr;
+
+    size_t len = _store->read(key, buff, RECORD_SIZE - 1);
+    if (len < 3)
+        return nullptr;
+    buff[len] = '\0';
+
+    // <flags><path>\0<value>\0
+    const char *storedPath = buff + 1;
+    size_t pathLen = strlen(storedPath);
+    if (pathLen + 2 >= len || strcmp(storedPath, path) != 0) {
+        log_w("Stored value %s belongs to %s instead of %s", key, storedPath, path);
+        return nullptr;
+    }
+
+    published = buff[0] & STATE_PUBLISHED;
+    _written[index] = hash(buff, len);
+    return storedPath + pathLen + 1;
+}
+
+void LastValueCache::loaded(Property &property, bool published) {
+    uint16_t index = indexOf(property);
+    if (index == _count)
+        return;
+
+    // Applying the value marked it dirty, it is only written again if the callback changed it
+    mark(index, STATE_LOADED | (published ? STATE_PUBLISHED : STATE_LOCAL), STATE_PUBLISHED | STATE_LOCAL);
+    _loaded++;
+}
+
+void LastValueCache::changed(Property &property) {
+    uint16_t index = indexOf(property);
+    if (index == _count)
+        return;
+
+    // Values set while the device is still coming up are defaults, they dont win against the broker
+    mark(index, STATE_DIRTY | (_tracking ? STATE_LOCAL : 0), STATE_PUBLISHED | STATE_LOADED);
+}
+
+void LastValueCache::published(Property &property) {
+    uint16_t index = indexOf(property);
+    if (index != _count)
+        mark(index, STATE_DIRTY | STATE_PUBLISHED, STATE_LOCAL);
+}
+
+bool LastValueCache::isNewer(Property &property) {
+    uint16_t index = indexOf(property);
+    if (index == _count)
+        return false;
+
+    uint8_t state = __atomic_load_n(&_state[index], __ATOMIC_ACQUIRE);
+    return (state & STATE_LOCAL) && !(state & STATE_PUBLISHED);
+}
+
+bool LastValueCache::isLoaded(Property &property) {
+    uint16_t index = indexOf(property);
+    return index != _count && (__atomic_load_n(&_state[index], __ATOMIC_ACQUIRE) & STATE_LOADED);
+}
+
+void LastValueCache::flush() {
+    if (!_store)
+        return;
+
+    xSemaphoreTake(_flushLock, portMAX_DELAY);
+    // Properties marked dirty from now on wake the task again
+    __atomic_store_n(&_pending, false, __ATOMIC_SEQ_CST);
+    char record[RECORD_SIZE];
+    char path[HOMIE_MAX_TOPIC_LEN + 1];
+    char key[16];
+    uint32_t writes = 0;
+    // Range of the records written, they are written again if the commit fails
+    uint16_t first = _count;
+    uint16_t last = 0;
+    for (uint16_t i = 0; i < _count; i++) {
+        if (!(__atomic_load_n(&_state[i], __ATOMIC_ACQUIRE) & STATE_DIRTY))
+            continue;
+
+        Property &property = *_index->get(i);
+        if (!makeKey(property, path, key))
+            continue;
+        size_t pathLen = strlen(path);
+
+        // Values and their state change with the value locked, so both are read under it
+        property.lockValue();
+        uint8_t state = __atomic_fetch_and(&_state[i], (uint8_t)~STATE_DIRTY, __ATOMIC_ACQ_REL);
+        const char *value = property.formatValue();
+        size_t valueLen = strlen(value);
+        bool fits = valueLen <= HOMIE_LAST_VALUE_LEN;
+        if (fits) {
+            record[0] = state & STATE_PUBLISHED;
+            memcpy(record + 1, path, pathLen + 1);
+            memcpy(record + 1 + pathLen + 1, value, valueLen + 1);
+        }
+        property.unlockValue();
+
+        if (!fits) {
+            log_w("Value of %s is longer than HOMIE_LAST_VALUE_LEN (%d), it isnt stored", path, HOMIE_LAST_VALUE_LEN);
+            continue;
+        }
+
+        size_t len = 1 + pathLen + 1 + valueLen + 1;
+        uint32_t h = hash(record, len);
+        if (h == _written[i])
+            continue;
+
+        if (!_store->write(key, record, len)) {
+            // Tried again with the next batch
+            log_w("Unable to store the value of %s", path);
+            mark(i, STATE_DIRTY, 0);
+            continue;
+        }
+        _written[i] = h;
+        writes++;
+        first = min(first, i);
+        last = i;
+    }
+
+    if (writes && !_store->commit()) {
+        log_w("Unable to commit %d last values", writes);
+        for (uint16_t i = first; i <= last; i++) {
+            _written[i] = 0;
+            mark(i, STATE_DIRTY, 0);
+        }
+    } else if (writes) {
+        _writes += writes;
+        _commits++;
+        log_v("Wrote %d last values", writes);
+    }
+    xSemaphoreGive(_flushLock);
+}
+
+void LastValueCache::writeTaskCode(void *parameter) {
+    LastValueCache *cache = (LastValueCache *)parameter;
+    for (;;) {
+#ifdef TASK_VERBOSE_LOGGING
+        log_v("writeTaskCode Task running on Core %d name %s", xPortGetCoreID(), pcTaskGetTaskName(nullptr));
+#endif
+        xSemaphoreTake(cache->_wake, portMAX_DELAY);
+        // Changes that follow within the debounce time go into the same commit
+        vTaskDelay(pdMS_TO_TICKS(HOMIE_LAST_VALUE_DEBOUNCE_MS));
+        cache->flush();
+    }
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <AsyncMqttClient.h>
+
+#include <LastValueStore.hpp>
+#include <MessagePool.hpp>
+#include <ModelArena.hpp>
+
+// Changed values are collected that long before they are written to the store
+#ifndef HOMIE_LAST_VALUE_DEBOUNCE_MS
+#define HOMIE_LAST_VALUE_DEBOUNCE_MS 3000
+#endif
+
+// Longest value that is kept, longer values arent stored
+#ifndef HOMIE_LAST_VALUE_LEN
+#define HOMIE_LAST_VALUE_LEN 200
+#endif
+
+#ifndef CONFIG_HOMIE_LAST_VALUE_RUNNING_CORE
+#define CONFIG_HOMIE_LAST_VALUE_RUNNING_CORE -1
+#endif
+
+class Property;
+class TopicIndex;
+
+/**
+ * @brief Keeps the values of the settable retained properties in a LastValueStore, so they are
+ * back right after a reboot instead of once the broker sent the retained values.
+ *
+ * Every record remembers if its value reached the broker. If it did, the retained value of the
+ * broker is at least as new and wins the restore. If it didnt, e.g. the value was set while the
+ * device was offline, the stored value wins and is published. The same holds for values set
+ * while the device is set up but disconnected.
+ *
+ * The state of the properties is kept in flat arrays indexed by Property::getIndex().
+ */
+class LastValueCache {
+   private:
+    enum {
+        STATE_DIRTY = 1,      // Has to be written to the store
+        STATE_PUBLISHED = 2,  // The current value reached the broker
+        STATE_LOCAL = 4,      // The current value was set without the broker knowing it
+        STATE_LOADED = 8      // The current value was loaded from the store
+    };
+
+    TopicIndex *_index = nullptr;
+    LastValueStore *_store = nullptr;
+    uint8_t *_state = nullptr;
+    // Hash of the record last written or loaded, to skip writing the same record again
+    uint32_t *_written = nullptr;
+    uint16_t _count = 0;
+    bool _tracking = false;
+    // Set once the write task was woken, cleared when a flush starts. A batch of changes wakes it once.
+    bool _pending = false;
+
+    SemaphoreHandle_t _wake;
+    SemaphoreHandle_t _flushLock;
+    TaskHandle_t _task = nullptr;
+
+    volatile uint32_t _loaded = 0;
+    volatile uint32_t _writes = 0;
+    volatile uint32_t _commits = 0;
+
+    static void writeTaskCode(void *parameter);
+
+    // Index of a property whose value is kept, _count for any other property
+    uint16_t indexOf(Property &property);
+
+    // Sets and clears state bits at once, wakes the write task once a property becomes dirty
+    void mark(uint16_t index, uint8_t set, uint8_t clear);
+
+    /**
+     * @brief Renders "<node>/<property>" into path and the record key, a hash of it, into key.
+     *
+     * @return false if the path is longer than HOMIE_MAX_TOPIC_LEN
+     */
+    static bool makeKey(Property &property, char *path, char *key);
+
+    static uint32_t hash(const char *data, size_t len);
+
+   public:
+    // Flags, "<node>/<property>", the value, each terminated
+    static const size_t RECORD_SIZE = 1 + HOMIE_MAX_TOPIC_LEN + 1 + HOMIE_LAST_VALUE_LEN + 1;
+
+    LastValueCache();
+
+    /**
+     * @brief Opens the store and starts the write task, the properties have to be indexed already.
+     */
+    bool begin(LastValueStore &store, TopicIndex &index, ModelArena &arena);
+
+    bool isEnabled() {
+        return _store != nullptr;
+    }
+
+    /**
+     * @brief Reads the stored value of a property.
+     *
+     * @param buff receives the record, has to hold RECORD_SIZE chars
+     * @param published receives whether the value reached the broker
+     * @return const char* the value within buff, nullptr if there is none
+     */
+    const char *read(Property &property, char *buff, bool &published);
+
+    /**
+     * @brief Marks the value of a property as loaded, once it was applied.
+     */
+    void loaded(Property &property, bool published);
+
+    /**
+     * @brief Values changed from now on are ones the broker doesnt know yet, called once the device is set up.
+     */
+    void startTracking() {
+        _tracking = true;
+    }
+
+    /**
+     * @brief Called whenever the value of a property changed, with the value of the property locked.
+     */
+    void changed(Property &property);
+
+    /**
+     * @brief Called once the current value of a property was handed to the connected MQTT client.
+     */
+    void published(Property &property);
+
+    /**
+     * @brief Checks if the current value of a property is newer than the retained value of the broker.
+     */
+    bool isNewer(Property &property);
+
+    /**
+     * @brief Checks if the current value of a property was loaded from the store.
+     */
+    bool isLoaded(Property &property);
+
+    /**
+     * @brief Writes the changed values to the store right away, the write task does so once they settled.
+     * Values the store didnt take or commit stay dirty and go with the next batch.
+     */
+    void flush();
+
+    /**
+     * @brief Number of values loaded from the store.
+     */
+    uint32_t getLoadedCount() {
+        return _loaded;
+    }
+
+    /**
+     * @brief Number of records written to the store.
+     */
+    uint32_t getWriteCount() {
+        return _writes;
+    }
+
+    /**
+     * @brief Number of commits, one per batch of writes.
+     */
+    uint32_t getCommitCount() {
+        return _commits;
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * @brief Storage the LastValueCache of the device keeps the property values in across reboots.
+ * Records are small blobs under short keys (at most 15 chars, like NVS keys), the cache
+ * encodes and checks them. NvsValueStore keeps them in NVS, FileValueStore in a file.
+ *
+ * A store is only used by one task at a time.
+ */
+class LastValueStore {
+   public:
+    virtual ~LastValueStore() {}
+
+    /**
+     * @brief Opens the store, called once before the stored values are loaded.
+     */
+    virtual bool begin() = 0;
+
+    /**
+     * @brief Reads the record stored under key.
+     *
+     * @return size_t its length, 0 if there is none or it doesnt fit into size bytes
+     */
+    virtual size_t read(const char *key, void *buff, size_t size) = 0;
+
+    /**
+     * @brief Replaces the record stored under key, it only has to be durable after the next commit().
+     */
+    virtual bool write(const char *key, const void *data, size_t len) = 0;
+
+    /**
+     * @brief Makes the writes since the last commit durable, called once per batch of writes.
+     */
+    virtual bool commit() = 0;
+};
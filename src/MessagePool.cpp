@@ -0,0 +1,115 @@
+#include <MessagePool.hpp>
+
+MessagePool::MessagePool(size_t size) : _size(size) {
+    _slots = new PublishQueueElement[size];
+    _freeSlots = xQueueCreate(size, sizeof(PublishQueueElement *));
+
+    for (size_t i = 0; i < size; i++) {
+        PublishQueueElement *elm = &_slots[i];
+        xQueueSendToBack(_freeSlots, &elm, 0);
+    }
+
+    if (HOMIE_MAX_MULTIPART_LEN > HOMIE_MAX_PAYLOAD_LEN)
+        _multipartBuffer = new char[HOMIE_MAX_MULTIPART_LEN + 1];
+}
+
+PublishQueueElement *MessagePool::acquire(TickType_t ticksToWait) {
+    PublishQueueElement *elm = nullptr;
+    if (!xQueueReceive(_freeSlots, &elm, ticksToWait)) {
+        _exhausted++;
+        return nullptr;
+    }
+
+    elm->payload = elm->inlinePayload;
+    _acquired++;
+    uint32_t inUse = getInUse();
+    if (inUse > _maxInUse)
+        _maxInUse = inUse;
+    return elm;
+}
+
+void MessagePool::release(PublishQueueElement *elm) {
+    if (!elm)
+        return;
+
+    if (elm->payload == _multipartBuffer)
+        _multipartBufferInUse = false;
+    xQueueSendToBack(_freeSlots, &elm, 0);
+}
+
+bool MessagePool::fits(size_t topicLen, size_t payloadLen) {
+    if (topicLen <= HOMIE_MAX_TOPIC_LEN && payloadLen <= HOMIE_MAX_PAYLOAD_LEN)
+        return true;
+
+    _oversized++;
+    return false;
+}
+
+size_t MessagePool::getInUse() {
+    return _size - uxQueueMessagesWaiting(_freeSlots);
+}
+
+void MessagePool::discardAssembling() {
+    release(_assembling);
+    _assembling = nullptr;
+    _multipartDiscarded++;
+}
+
+PublishQueueElement *MessagePool::assemble(const char *topic, const char *payload, AsyncMqttClientMessageProperties properties,
+                                           size_t len, size_t index, size_t total, TickType_t ticksToWait) {
+    if (index == 0) {
+        if (_assembling)
+            discardAssembling();
+
+        size_t topicLen = strlen(topic);
+        bool large = total > HOMIE_MAX_PAYLOAD_LEN;
+        if (topicLen > HOMIE_MAX_TOPIC_LEN || (large && (!_multipartBuffer || total > HOMIE_MAX_MULTIPART_LEN))) {
+            // The remaining parts find nothing to continue and are dropped as well
+            _oversized++;
+            return nullptr;
+        }
+
+        if (large && _multipartBufferInUse) {
+            _exhausted++;
+            return nullptr;
+        }
+
+        PublishQueueElement *elm = acquire(ticksToWait);
+        if (!elm)
+            return nullptr;
+
+        if (large) {
+            _multipartBufferInUse = true;
+            elm->payload = _multipartBuffer;
+        }
+        memcpy(elm->topic, topic, topicLen + 1);
+        elm->mqttProps = properties;
+
+        _assembling = elm;
+        _assembledLen = 0;
+        _assemblingTotal = total;
+    } else if (!_assembling) {
+        // Rest of a message that was already dropped
+        return nullptr;
+    } else if (index != _assembledLen || total != _assemblingTotal || strcmp(_assembling->topic, topic) != 0) {
+        discardAssembling();
+        return nullptr;
+    }
+
+    if (_assembledLen + len > _assemblingTotal) {
+        discardAssembling();
+        return nullptr;
+    }
+
+    memcpy(_assembling->payload + index, payload, len);
+    _assembledLen += len;
+    if (_assembledLen < _assemblingTotal)
+        return nullptr;
+
+    PublishQueueElement *elm = _assembling;
+    elm->payload[_assemblingTotal] = '\0';
+    elm->payloadLen = _assemblingTotal;
+    _assembling = nullptr;
+    _multipartAssembled++;
+    return elm;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <AsyncMqttClient.h>
+
+#ifndef HOMIE_MAX_TOPIC_LEN
+#define HOMIE_MAX_TOPIC_LEN 128
+#endif
+
+#ifndef HOMIE_MAX_PAYLOAD_LEN
+#define HOMIE_MAX_PAYLOAD_LEN 200
+#endif
+
+// Budget for one multipart message that doesnt fit into a slot, 0 disables them.
+#ifndef HOMIE_MAX_MULTIPART_LEN
+#define HOMIE_MAX_MULTIPART_LEN 2048
+#endif
+
+struct PublishQueueElement {
+    char topic[HOMIE_MAX_TOPIC_LEN + 1];
+    // Points to inlinePayload, or to the multipart buffer for large messages
+    char *payload;
+    size_t payloadLen;
+    AsyncMqttClientMessageProperties mqttProps;
+    char inlinePayload[HOMIE_MAX_PAYLOAD_LEN + 1];
+};
+
+/**
+ * @brief Fixed set of PublishQueueElement slots for incoming MQTT messages.
+ * All slots are allocated once on construction, afterwards acquiring and
+ * releasing a slot only moves its pointer through a FreeRTOS queue, so
+ * receiving a message never touches the heap.
+ *
+ * Messages AsyncMqttClient delivers in several parts are reassembled in place,
+ * either in the slot itself or, if they are larger, in the single multipart
+ * buffer of HOMIE_MAX_MULTIPART_LEN bytes. MQTT delivers one message after the
+ * other, so only one message can be in reassembly at a time.
+ */
+class MessagePool {
+   private:
+    PublishQueueElement *_slots;
+    size_t _size;
+    QueueHandle_t _freeSlots;
+
+    char *_multipartBuffer = nullptr;
+    volatile bool _multipartBufferInUse = false;
+    PublishQueueElement *_assembling = nullptr;
+    size_t _assembledLen = 0;
+    size_t _assemblingTotal = 0;
+
+    volatile uint32_t _acquired = 0;
+    volatile uint32_t _exhausted = 0;
+    volatile uint32_t _oversized = 0;
+    volatile uint32_t _maxInUse = 0;
+    volatile uint32_t _multipartAssembled = 0;
+    volatile uint32_t _multipartDiscarded = 0;
+
+    void discardAssembling();
+
+   public:
+    MessagePool(size_t size);
+
+    /**
+     * @brief Takes a free slot, waits up to ticksToWait for one to be released.
+     *
+     * @return PublishQueueElement* or nullptr if all slots are in use
+     */
+    PublishQueueElement *acquire(TickType_t ticksToWait);
+
+    /**
+     * @brief Returns a slot taken with acquire() to the pool.
+     */
+    void release(PublishQueueElement *elm);
+
+    /**
+     * @brief Checks if a message fits into a slot, counts it as oversized if not.
+     */
+    bool fits(size_t topicLen, size_t payloadLen);
+
+    /**
+     * @brief Adds one part of a multipart message, parts have to arrive in order.
+     * A new first part discards an incomplete message, out of order parts and
+     * messages over the budget are discarded as well.
+     *
+     * @return PublishQueueElement* the complete message once the last part arrived, nullptr before
+     */
+    PublishQueueElement *assemble(const char *topic, const char *payload, AsyncMqttClientMessageProperties properties,
+                                  size_t len, size_t index, size_t total, TickType_t ticksToWait);
+
+    size_t getSize() {
+        return _size;
+    }
+
+    size_t getInUse();
+
+    /**
+     * @brief Highest number of slots that were in use at the same time.
+     */
+    uint32_t getMaxInUse() {
+        return _maxInUse;
+    }
+
+    uint32_t getAcquiredCount() {
+        return _acquired;
+    }
+
+    /**
+     * @brief Number of messages dropped because no slot was free.
+     */
+    uint32_t getExhaustedCount() {
+        return _exhausted;
+    }
+
+    /**
+     * @brief Number of messages dropped because topic or payload didnt fit into a slot.
+     */
+    uint32_t getOversizedCount() {
+        return _oversized;
+    }
+
+    uint32_t getMultipartAssembledCount() {
+        return _multipartAssembled;
+    }
+
+    /**
+     * @brief Number of incomplete multipart messages that were discarded.
+     */
+    uint32_t getMultipartDiscardedCount() {
+        return _multipartDiscarded;
+    }
+};
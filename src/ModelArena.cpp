@@ -0,0 +1,189 @@
+#include <string.h>
+
+#include <soc/soc.h>
+
+#include <ModelArena.hpp>
+#include "MqttLogger.hpp"
+
+ModelArena::ModelArena() {
+    _lock = xSemaphoreCreateMutex();
+}
+
+ModelArena::~ModelArena() {
+    while (_chunks) {
+        Chunk *next = _chunks->next;
+        delete[](char *) _chunks;
+        _chunks = next;
+    }
+    delete[] _table;
+    vSemaphoreDelete(_lock);
+}
+
+bool ModelArena::isConstant(const char *s) {
+    return (uintptr_t)s >= SOC_DROM_LOW && (uintptr_t)s < SOC_DROM_HIGH;
+}
+
+uint32_t ModelArena::hash(const char *s, size_t len) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+ModelArena::Chunk *ModelArena::addChunk(size_t size) {
+    Chunk *chunk = (Chunk *)new char[sizeof(Chunk) + size];
+    chunk->next = nullptr;
+    chunk->size = size;
+    chunk->used = 0;
+    _capacity += sizeof(Chunk) + size;
+    _chunkCount++;
+    return chunk;
+}
+
+void *ModelArena::take(Chunk *chunk, size_t size, size_t align) {
+    uintptr_t next = (uintptr_t)(chunk + 1) + chunk->used;
+    size_t pad = (align - next % align) % align;
+    if (chunk->size - chunk->used < pad + size)
+        return nullptr;
+    chunk->used += pad + size;
+    _bytes += pad + size;
+    return (void *)(next + pad);
+}
+
+void ModelArena::reserve(size_t bytes) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if (!_sealed && (!_chunks || _chunks->size - _chunks->used < bytes)) {
+        Chunk *chunk = addChunk(bytes);
+        chunk->next = _chunks;
+        _chunks = chunk;
+    }
+    xSemaphoreGive(_lock);
+}
+
+void *ModelArena::allocate(size_t size, size_t align) {
+    void *p = nullptr;
+    if (!__atomic_load_n(&_sealed, __ATOMIC_ACQUIRE)) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        if (!_sealed)
+            p = fill(size, align);
+        xSemaphoreGive(_lock);
+    }
+    if (p)
+        return p;
+
+    __atomic_add_fetch(&_late, 1, __ATOMIC_RELAXED);
+    log_w("Model arena is sealed, allocating %d bytes from the heap", size);
+    return ::operator new(size);
+}
+
+void *ModelArena::fill(size_t size, size_t align) {
+    void *p;
+    if (_chunks && (p = take(_chunks, size, align)))
+        return p;
+
+    // An allocation larger than a chunk gets one of its own, it doesnt end the chunk that is being filled
+    size_t needed = size + align - 1;
+    Chunk *chunk;
+    if (needed > HOMIE_MODEL_ARENA_CHUNK) {
+        chunk = addChunk(needed);
+        if (_chunks) {
+            chunk->next = _chunks->next;
+            _chunks->next = chunk;
+        } else {
+            _chunks = chunk;
+        }
+    } else {
+        chunk = addChunk(HOMIE_MODEL_ARENA_CHUNK);
+        chunk->next = _chunks;
+        _chunks = chunk;
+    }
+    return take(chunk, size, align);
+}
+
+bool ModelArena::owns(const void *p) {
+    bool found = false;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (Chunk *chunk = _chunks; chunk && !found; chunk = chunk->next) {
+        const char *base = (const char *)(chunk + 1);
+        found = (const char *)p >= base && (const char *)p < base + chunk->size;
+    }
+    xSemaphoreGive(_lock);
+    return found;
+}
+
+void ModelArena::release(void *p) {
+    if (p && !owns(p))
+        ::operator delete(p);
+}
+
+void ModelArena::seal() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    bool sealed = _sealed;
+    __atomic_store_n(&_sealed, true, __ATOMIC_RELEASE);
+    xSemaphoreGive(_lock);
+    if (sealed)
+        return;
+
+    // Strings interned from now on are copied without looking for an equal one
+    delete[] _table;
+    _table = nullptr;
+    _tableSize = 0;
+    _count = 0;
+    log_i("Model arena sealed, %d bytes used of %d bytes in %d chunks", _bytes, _capacity, _chunkCount);
+}
+
+void ModelArena::insert(const char *s, uint32_t h) {
+    size_t mask = _tableSize - 1;
+    size_t i = h & mask;
+    while (_table[i])
+        i = (i + 1) & mask;
+    _table[i] = s;
+}
+
+void ModelArena::grow() {
+    const char **old = _table;
+    size_t oldSize = _tableSize;
+
+    _tableSize = oldSize ? oldSize * 2 : 64;
+    _table = new const char *[_tableSize]();
+    for (size_t i = 0; i < oldSize; i++) {
+        if (old[i])
+            insert(old[i], hash(old[i], strlen(old[i])));
+    }
+    delete[] old;
+}
+
+const char *ModelArena::intern(const char *s) {
+    if (!s)
+        return nullptr;
+
+    if (isConstant(s)) {
+        _borrowed++;
+        return s;
+    }
+
+    size_t len = strlen(s);
+    uint32_t h = hash(s, len);
+    if (_tableSize) {
+        size_t mask = _tableSize - 1;
+        for (size_t i = h & mask; _table[i]; i = (i + 1) & mask) {
+            if (strcmp(_table[i], s) == 0) {
+                _shared++;
+                return _table[i];
+            }
+        }
+    }
+
+    // Kept at most half full, so the probes above stay short
+    if (!_sealed && (_count + 1) * 2 > _tableSize)
+        grow();
+
+    char *copy = (char *)allocate(len + 1, 1);
+    memcpy(copy, s, len + 1);
+    if (!_sealed) {
+        insert(copy, h);
+        _count++;
+    }
+    return copy;
+}
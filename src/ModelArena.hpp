@@ -0,0 +1,185 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <utility>
+
+// Allocations are packed into chunks of this size, larger ones get a chunk of their own
+#ifndef HOMIE_MODEL_ARENA_CHUNK
+#define HOMIE_MODEL_ARENA_CHUNK 1024
+#endif
+
+// Size of the first chunk, e.g. the footprint a previous boot reported. 0 starts with HOMIE_MODEL_ARENA_CHUNK
+#ifndef HOMIE_MODEL_ARENA_SIZE
+#define HOMIE_MODEL_ARENA_SIZE 0
+#endif
+
+/**
+ * @brief Device wide storage for the model: the nodes, properties and stats, their value
+ * buffers and enum tables, the ids, names, units and formats and the $nodes/$properties payloads.
+ * Everything is placed into a few large chunks instead of a heap block each. Equal
+ * strings (units, formats, ...) share one copy and string literals, which are read from
+ * flash anyway, arent copied at all. Nothing is freed before the arena goes away, a
+ * replaced string or buffer stays in the arena.
+ *
+ * The device seals the arena once setup and the first restore are done. Its footprint
+ * doesnt change from then on, later allocations are served from the heap, counted and logged.
+ *
+ * Interning isnt thread safe, it is only done while the model is built. Allocations are,
+ * e.g. a value buffer that grows while the setup task fills the arena.
+ */
+class ModelArena {
+   private:
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+        size_t used;
+    };
+
+    Chunk *_chunks = nullptr;
+    // Open addressing table of the copied strings, its size is a power of two. Dropped when sealed.
+    const char **_table = nullptr;
+    size_t _tableSize = 0;
+    size_t _count = 0;
+
+    SemaphoreHandle_t _lock;
+    bool _sealed = false;
+    size_t _bytes = 0;
+    size_t _capacity = 0;
+    uint16_t _chunkCount = 0;
+    uint32_t _shared = 0;
+    uint32_t _borrowed = 0;
+    uint32_t _late = 0;
+
+    static uint32_t hash(const char *s, size_t len);
+    Chunk *addChunk(size_t size);
+    // Takes size bytes aligned to align from the chunk, nullptr if they dont fit
+    void *take(Chunk *chunk, size_t size, size_t align);
+    // Has to be called with _lock held
+    void *fill(size_t size, size_t align);
+    void insert(const char *s, uint32_t h);
+    void grow();
+
+   public:
+    ModelArena();
+    ModelArena(const ModelArena &) = delete;
+    ModelArena &operator=(const ModelArena &) = delete;
+    ~ModelArena();
+
+    /**
+     * @brief Makes sure the next allocations up to bytes fit into the current chunk, e.g.
+     * with the footprint of the last boot, so the whole model ends up in one block.
+     */
+    void reserve(size_t bytes);
+
+    /**
+     * @brief Returns size bytes that live as long as the arena, from the heap once sealed.
+     */
+    void *allocate(size_t size, size_t align = alignof(max_align_t));
+
+    /**
+     * @brief Gives back a buffer of allocate() that is replaced, only heap blocks are actually freed.
+     */
+    void release(void *p);
+
+    /**
+     * @brief Constructs a T in the arena, destroy() it again.
+     */
+    template <typename T, typename... Args>
+    T *create(Args &&...args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Destroys a T of create(), or deletes it if it was allocated with new, e.g. a Node added by the user.
+     */
+    template <typename T>
+    void destroy(T *p) {
+        if (!p)
+            return;
+        if (owns(p)) {
+            p->~T();
+        } else {
+            delete p;
+        }
+    }
+
+    /**
+     * @brief Allocates count default initialized T, they are never destroyed.
+     */
+    template <typename T>
+    T *allocateArray(size_t count) {
+        T *items = (T *)allocate(sizeof(T) * count, alignof(T));
+        for (size_t i = 0; i < count; i++)
+            new (&items[i]) T();
+        return items;
+    }
+
+    /**
+     * @brief Returns a copy of s that lives as long as the arena.
+     *
+     * @return const char* s itself if it is a literal in flash, an earlier copy of an equal string or a new copy
+     */
+    const char *intern(const char *s);
+
+    /**
+     * @brief Checks if s points into flash, e.g. a string literal.
+     */
+    static bool isConstant(const char *s);
+
+    /**
+     * @brief Checks if p points into one of the chunks.
+     */
+    bool owns(const void *p);
+
+    /**
+     * @brief Ends the construction of the model, logs the footprint and frees the string table.
+     */
+    void seal();
+
+    bool isSealed() {
+        return this->_sealed;
+    }
+
+    /**
+     * @brief Bytes handed out, including alignment. The exact footprint of the model once sealed.
+     */
+    size_t getBytes() {
+        return this->_bytes;
+    }
+
+    /**
+     * @brief Bytes allocated for chunks, including their headers and unused tails.
+     */
+    size_t getCapacity() {
+        return this->_capacity;
+    }
+
+    uint16_t getChunkCount() {
+        return this->_chunkCount;
+    }
+
+    /**
+     * @brief Number of interned strings that reused an earlier copy.
+     */
+    uint32_t getSharedCount() {
+        return this->_shared;
+    }
+
+    /**
+     * @brief Number of interned strings that were literals and werent copied.
+     */
+    uint32_t getBorrowedCount() {
+        return this->_borrowed;
+    }
+
+    /**
+     * @brief Number of allocations after the arena was sealed, served from the heap.
+     */
+    uint32_t getLateCount() {
+        return __atomic_load_n(&_late, __ATOMIC_RELAXED);
+    }
+};
@@ -4,30 +4,171 @@
 AsyncMqttClient* MqttLogger::_client = nullptr;
 const char* MqttLogger::_deviceId = nullptr;
 
+MqttLogger::LogLine MqttLogger::_lines[HOMIE_LOG_LINES];
+uint32_t MqttLogger::_enqueuePos = 0;
+uint32_t MqttLogger::_dequeuePos = 0;
+volatile uint32_t MqttLogger::_dropped = 0;
+uint32_t MqttLogger::_reportedDropped = 0;
+
+char* MqttLogger::_topic = nullptr;
+char* MqttLogger::_levelTopic = nullptr;
+char* MqttLogger::_levelSetTopic = nullptr;
+volatile esp_log_level_t MqttLogger::_level = (esp_log_level_t)HOMIE_LOG_LEVEL_MQTT;
+char MqttLogger::_batch[HOMIE_LOG_BATCH_LEN + 1];
+size_t MqttLogger::_batchLen = 0;
+TaskHandle_t MqttLogger::_task = nullptr;
+
+static_assert((HOMIE_LOG_LINES & (HOMIE_LOG_LINES - 1)) == 0, "HOMIE_LOG_LINES has to be a power of two");
+
+static const char* levelNames[] = {"none", "error", "warn", "info", "debug", "verbose"};
+
 void MqttLogger::init(AsyncMqttClient* client, const char* deviceId) {
-    _client = client;
+    // Called on every reconnect, the buffer and the task are only set up once
+    if (!_task) {
+        for (uint32_t i = 0; i < HOMIE_LOG_LINES; i++)
+            _lines[i].seq = i;
+
+        char* topic = new char[6 + strlen(deviceId) + 1];
+        strcpy(topic, "debug/");
+        strcat(topic, deviceId);
+        _topic = topic;
+
+        char* levelTopic = new char[strlen(topic) + 6 + 1];
+        strcpy(levelTopic, topic);
+        strcat(levelTopic, "/level");
+        _levelTopic = levelTopic;
+
+        char* levelSetTopic = new char[strlen(levelTopic) + 4 + 1];
+        strcpy(levelSetTopic, levelTopic);
+        strcat(levelSetTopic, "/set");
+        _levelSetTopic = levelSetTopic;
+
+        xTaskCreateUniversal(
+            logTaskCode,
+            "homie_logger",
+            4096,
+            nullptr,
+            1,
+            &_task,
+            CONFIG_HOMIE_LOG_RUNNING_CORE);
+    }
+
     _deviceId = deviceId;
+    __atomic_store_n(&_client, client, __ATOMIC_RELEASE);
+
+    client->subscribe(_levelSetTopic, 1);
+    client->publish(_levelTopic, 1, true, levelNames[_level]);
+}
+
+void MqttLogger::setLevel(esp_log_level_t level) {
+    _level = (esp_log_level_t)min((int)level, HOMIE_LOG_LEVEL_MQTT);
+    if (_client)
+        _client->publish(_levelTopic, 1, true, levelNames[_level]);
+}
+
+bool MqttLogger::handleMessage(const char* topic, const char* payload) {
+    if (!_levelSetTopic || strcmp(topic, _levelSetTopic) != 0)
+        return false;
+
+    for (int level = ESP_LOG_NONE; level <= ESP_LOG_VERBOSE; level++) {
+        if (strcmp(payload, levelNames[level]) == 0 || (payload[0] == '0' + level && payload[1] == '\0')) {
+            setLevel((esp_log_level_t)level);
+            return true;
+        }
+    }
+    ESP_LOG_W(TAG, "Unknown log level '%s'", payload);
+    return true;
 }
 
 void MqttLogger::log(const char* tag, const char* format, ...) {
-    if (!_client || !_deviceId) return;
+    if (!__atomic_load_n(&_client, __ATOMIC_ACQUIRE)) return;
 
-    ESP_LOG_I(tag, "Logging to MQTT");
+    // Claim the next free slot, multiple tasks may log at the same time
+    uint32_t pos = __atomic_load_n(&_enqueuePos, __ATOMIC_RELAXED);
+    LogLine* line;
+    for (;;) {
+        line = &_lines[pos & (HOMIE_LOG_LINES - 1)];
+        int32_t diff = (int32_t)(__atomic_load_n(&line->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&_enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            // The logger task didnt get to the line that was in this slot yet
+            __atomic_fetch_add(&_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&_enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
 
-    char buffer[256];
     va_list args;
     va_start(args, format);
-    
+
     // Add tag to the message
-    int prefixLen = snprintf(buffer, sizeof(buffer), "[%s] ", tag);
-    vsnprintf(buffer + prefixLen, sizeof(buffer) - prefixLen, format, args);
-    
+    int len = snprintf(line->text, sizeof(line->text), "[%s] ", tag);
+    if (len >= 0 && (size_t)len < sizeof(line->text))
+        len += vsnprintf(line->text + len, sizeof(line->text) - len, format, args);
+
     va_end(args);
 
-    char topic[64];
-    snprintf(topic, sizeof(topic), "debug/%s", _deviceId);
-    
-    ESP_LOG_I(TAG, "Publishing to topic: %s", topic);
+    line->len = len < 0 ? 0 : min((size_t)len, sizeof(line->text) - 1);
+    __atomic_store_n(&line->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+void MqttLogger::publishBatch() {
+    if (_batchLen == 0)
+        return;
+
+    _batch[_batchLen] = '\0';
+    _client->publish(_topic, 0, false, _batch, _batchLen);
+    _batchLen = 0;
+}
+
+void MqttLogger::appendToBatch(const char* text, size_t len) {
+    size_t separator = _batchLen > 0 ? 1 : 0;
+    if (_batchLen + separator + len > HOMIE_LOG_BATCH_LEN)
+        publishBatch();
+
+    if (_batchLen > 0)
+        _batch[_batchLen++] = '\n';
+    memcpy(_batch + _batchLen, text, len);
+    _batchLen += len;
+}
+
+void MqttLogger::flush() {
+    LogLine* first = &_lines[_dequeuePos & (HOMIE_LOG_LINES - 1)];
+    if (__atomic_load_n(&first->seq, __ATOMIC_ACQUIRE) != _dequeuePos + 1 && _dropped == _reportedDropped)
+        return;
+
+    // Lines wait in the buffer until we are connected again, newer ones are dropped if it runs full
+    if (!_client->connected())
+        return;
+
+    for (;;) {
+        LogLine* line = &_lines[_dequeuePos & (HOMIE_LOG_LINES - 1)];
+        if (__atomic_load_n(&line->seq, __ATOMIC_ACQUIRE) != _dequeuePos + 1)
+            break;
+
+        appendToBatch(line->text, line->len);
+        // Hand the slot back to the producers for the next round through the ring
+        __atomic_store_n(&line->seq, _dequeuePos + HOMIE_LOG_LINES, __ATOMIC_RELEASE);
+        _dequeuePos++;
+    }
 
-    _client->publish(topic, 0, false, buffer);
-} 
\ No newline at end of file
+    uint32_t dropped = _dropped;
+    if (dropped != _reportedDropped) {
+        char text[48];
+        int len = snprintf(text, sizeof(text), "[%s] dropped %u lines", TAG, dropped - _reportedDropped);
+        appendToBatch(text, min((size_t)len, sizeof(text) - 1));
+        _reportedDropped = dropped;
+    }
+
+    publishBatch();
+}
+
+void MqttLogger::logTaskCode(void* parameter) {
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(HOMIE_LOG_FLUSH_MS));
+        flush();
+    }
+}
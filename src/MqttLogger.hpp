@@ -3,14 +3,121 @@
 #include <AsyncMqttClient.h>
 #include <esp_log.h>  // For normal ESP logging
 
+#undef TAG
 #define TAG "MqttLogger"
 
+// Lines the ring buffer holds until the logger task publishes them, has to be a power of two
+#ifndef HOMIE_LOG_LINES
+#define HOMIE_LOG_LINES 32
+#endif
+
+// Longer lines are cut off
+#ifndef HOMIE_LOG_LINE_LEN
+#define HOMIE_LOG_LINE_LEN 128
+#endif
+
+// Lines are joined by '\n' into publishes of at most this size
+#ifndef HOMIE_LOG_BATCH_LEN
+#define HOMIE_LOG_BATCH_LEN 1024
+#endif
+
+#ifndef HOMIE_LOG_FLUSH_MS
+#define HOMIE_LOG_FLUSH_MS 100
+#endif
+
+// Compile time levels of the two sinks, 0 none, 1 error, 2 warn, 3 info, 4 debug, 5 verbose
+#ifndef HOMIE_LOG_LEVEL_SERIAL
+#ifdef CORE_DEBUG_LEVEL
+#define HOMIE_LOG_LEVEL_SERIAL CORE_DEBUG_LEVEL
+#else
+#define HOMIE_LOG_LEVEL_SERIAL 3
+#endif
+#endif
+
+#ifndef HOMIE_LOG_LEVEL_MQTT
+#define HOMIE_LOG_LEVEL_MQTT 3
+#endif
+
+#ifndef CONFIG_HOMIE_LOG_RUNNING_CORE
+#define CONFIG_HOMIE_LOG_RUNNING_CORE -1
+#endif
+
+/**
+ * Sends the log lines to "debug/<deviceId>" in addition to the serial output.
+ *
+ * log() only formats the line into a slot of a fixed ring buffer, claiming a
+ * slot is a single compare and swap, so logging neither blocks nor allocates.
+ * A low priority task publishes the buffered lines every HOMIE_LOG_FLUSH_MS,
+ * several lines per publish. If the buffer is full the line is dropped and
+ * counted, the count is reported in the next publish.
+ *
+ * Lines below HOMIE_LOG_LEVEL_MQTT are not compiled in. Up to that level the
+ * runtime level decides, it can be changed by publishing one of
+ * none/error/warn/info/debug/verbose (or 0-5) to "debug/<deviceId>/level/set".
+ */
 class MqttLogger {
+private:
+    struct LogLine {
+        // Sequence number of the ring position the slot holds, tells producer and consumer whose turn it is
+        uint32_t seq;
+        uint16_t len;
+        char text[HOMIE_LOG_LINE_LEN];
+    };
+
+    static LogLine _lines[HOMIE_LOG_LINES];
+    static uint32_t _enqueuePos;
+    static uint32_t _dequeuePos;
+    static volatile uint32_t _dropped;
+    static uint32_t _reportedDropped;
+
+    static char *_topic;
+    static char *_levelTopic;
+    static char *_levelSetTopic;
+    static volatile esp_log_level_t _level;
+    static char _batch[HOMIE_LOG_BATCH_LEN + 1];
+    static size_t _batchLen;
+    static TaskHandle_t _task;
+
+    static void logTaskCode(void *parameter);
+    static void flush();
+    static void appendToBatch(const char *text, size_t len);
+    static void publishBatch();
+
 public:
     static void init(AsyncMqttClient* client, const char* deviceId);
     static void log(const char* tag, const char* format, ...);
     static AsyncMqttClient* _client;
     static const char* _deviceId;
+
+    /**
+     * @brief Checks if a line of the given level would be sent, before any formatting is done.
+     */
+    static bool isEnabled(esp_log_level_t level) {
+        return level <= _level && _client;
+    }
+
+    /**
+     * @brief Set the runtime level of the MQTT sink, it cant enable lines above HOMIE_LOG_LEVEL_MQTT.
+     */
+    static void setLevel(esp_log_level_t level);
+
+    static esp_log_level_t getLevel() {
+        return _level;
+    }
+
+    /**
+     * @brief Applies a level received on "debug/<deviceId>/level/set".
+     *
+     * @return true if the topic was the level topic
+     */
+    static bool handleMessage(const char* topic, const char* payload);
+
+    /**
+     * @brief Number of lines that didnt fit into the ring buffer.
+     */
+    static uint32_t getDroppedCount() {
+        return _dropped;
+    }
 };
 
 // Store original ESP logging macros
@@ -20,6 +127,69 @@ public:
 #define ESP_LOG_E(tag, format, ...) esp_log_write(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
 #define ESP_LOG_V(tag, format, ...) esp_log_write(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
 
+// Calls below the level of a sink compile to nothing, see HOMIE_LOG_LEVEL_SERIAL and HOMIE_LOG_LEVEL_MQTT
+#define HOMIE_LOG_NOTHING() \
+    do { \
+    } while (0)
+
+#define HOMIE_LOG_MQTT(level, format, ...) \
+    do { \
+        if (MqttLogger::isEnabled(level)) \
+            MqttLogger::log(TAG, format, ##__VA_ARGS__); \
+    } while (0)
+
+#if HOMIE_LOG_LEVEL_SERIAL >= 1
+#define HOMIE_LOG_SERIAL_E(format, ...) ESP_LOG_E(TAG, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_SERIAL_E(format, ...) HOMIE_LOG_NOTHING()
+#endif
+#if HOMIE_LOG_LEVEL_SERIAL >= 2
+#define HOMIE_LOG_SERIAL_W(format, ...) ESP_LOG_W(TAG, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_SERIAL_W(format, ...) HOMIE_LOG_NOTHING()
+#endif
+#if HOMIE_LOG_LEVEL_SERIAL >= 3
+#define HOMIE_LOG_SERIAL_I(format, ...) ESP_LOG_I(TAG, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_SERIAL_I(format, ...) HOMIE_LOG_NOTHING()
+#endif
+#if HOMIE_LOG_LEVEL_SERIAL >= 4
+#define HOMIE_LOG_SERIAL_D(format, ...) ESP_LOG_D(TAG, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_SERIAL_D(format, ...) HOMIE_LOG_NOTHING()
+#endif
+#if HOMIE_LOG_LEVEL_SERIAL >= 5
+#define HOMIE_LOG_SERIAL_V(format, ...) ESP_LOG_V(TAG, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_SERIAL_V(format, ...) HOMIE_LOG_NOTHING()
+#endif
+
+#if HOMIE_LOG_LEVEL_MQTT >= 1
+#define HOMIE_LOG_MQTT_E(format, ...) HOMIE_LOG_MQTT(ESP_LOG_ERROR, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_MQTT_E(format, ...) HOMIE_LOG_NOTHING()
+#endif
+#if HOMIE_LOG_LEVEL_MQTT >= 2
+#define HOMIE_LOG_MQTT_W(format, ...) HOMIE_LOG_MQTT(ESP_LOG_WARN, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_MQTT_W(format, ...) HOMIE_LOG_NOTHING()
+#endif
+#if HOMIE_LOG_LEVEL_MQTT >= 3
+#define HOMIE_LOG_MQTT_I(format, ...) HOMIE_LOG_MQTT(ESP_LOG_INFO, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_MQTT_I(format, ...) HOMIE_LOG_NOTHING()
+#endif
+#if HOMIE_LOG_LEVEL_MQTT >= 4
+#define HOMIE_LOG_MQTT_D(format, ...) HOMIE_LOG_MQTT(ESP_LOG_DEBUG, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_MQTT_D(format, ...) HOMIE_LOG_NOTHING()
+#endif
+#if HOMIE_LOG_LEVEL_MQTT >= 5
+#define HOMIE_LOG_MQTT_V(format, ...) HOMIE_LOG_MQTT(ESP_LOG_VERBOSE, format, ##__VA_ARGS__)
+#else
+#define HOMIE_LOG_MQTT_V(format, ...) HOMIE_LOG_NOTHING()
+#endif
+
 // Redefine logging macros to do both
 #undef log_i
 #undef log_d
@@ -29,27 +199,27 @@ public:
 
 #define log_i(format, ...) \
     do { \
-        ESP_LOG_I(TAG, format, ##__VA_ARGS__); \
-        MqttLogger::log(TAG, format, ##__VA_ARGS__); \
+        HOMIE_LOG_SERIAL_I(format, ##__VA_ARGS__); \
+        HOMIE_LOG_MQTT_I(format, ##__VA_ARGS__); \
     } while(0)
 
 #define log_d(format, ...) \
     do { \
-        ESP_LOG_D(TAG, format, ##__VA_ARGS__); \
-        MqttLogger::log(TAG, format, ##__VA_ARGS__); \
+        HOMIE_LOG_SERIAL_D(format, ##__VA_ARGS__); \
+        HOMIE_LOG_MQTT_D(format, ##__VA_ARGS__); \
     } while(0)
 #define log_w(format, ...) \
     do { \
-        ESP_LOG_W(TAG, format, ##__VA_ARGS__); \
-        MqttLogger::log(TAG, format, ##__VA_ARGS__); \
+        HOMIE_LOG_SERIAL_W(format, ##__VA_ARGS__); \
+        HOMIE_LOG_MQTT_W(format, ##__VA_ARGS__); \
     } while(0)
 #define log_e(format, ...) \
     do { \
-        ESP_LOG_E(TAG, format, ##__VA_ARGS__); \
-        MqttLogger::log(TAG, format, ##__VA_ARGS__); \
+        HOMIE_LOG_SERIAL_E(format, ##__VA_ARGS__); \
+        HOMIE_LOG_MQTT_E(format, ##__VA_ARGS__); \
     } while(0)
 #define log_v(format, ...) \
     do { \
-        ESP_LOG_V(TAG, format, ##__VA_ARGS__); \
-        MqttLogger::log(TAG, format, ##__VA_ARGS__); \
+        HOMIE_LOG_SERIAL_V(format, ##__VA_ARGS__); \
+        HOMIE_LOG_MQTT_V(format, ##__VA_ARGS__); \
     } while(0)
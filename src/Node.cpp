@@ -6,29 +6,44 @@ Node::Node(Device &src, AsyncMqttClient &client, const char *id) : _parent(src),
                                                                    _name(nullptr),
                                                                    _type(nullptr),
                                                                    _client(client) {
-    char *idBuff = new char[strlen(id) + 1];
-    strcpy(idBuff, id);
-    _id = idBuff;
+    _id = src.getArena().intern(id);
+}
+
+Node::Node(Device &src, AsyncMqttClient &client, const HomieNodeSpec &spec) : _parent(src),
+                                                                           _name(spec.name),
+                                                                           _id(spec.id),
+                                                                           _type(spec.type),
+                                                                           _spec(&spec),
+                                                                           _client(client) {
+    _properties.reserve(spec.propertyCount);
+    for (size_t i = 0; i < spec.propertyCount; i++)
+        addProperty(*_parent.getArena().create<Property>(*this, _client, spec.properties[i]));
+}
+
+Node::~Node() {
+    for (auto &&prop : _properties) {
+        _parent.getArena().destroy(prop);
+    }
+}
+
+void Node::setName(const char *name) {
+    _name = _parent.getArena().intern(name);
+}
+
+void Node::setType(const char *type) {
+    _type = _parent.getArena().intern(type);
 }
 
 Property &Node::addProperty(const char *id, const char *name, HomieDataType dataType) {
-    return addProperty(*new Property(*this, _client, id, name, dataType));
+    return addProperty(*_parent.getArena().create<Property>(*this, _client, id, name, dataType));
 }
 
 Property &Node::addProperty(Property &property) {
     this->_properties.push_back(&property);
+    _propertiesPayload = nullptr;
     return property;
 }
 
-char *Node::prefixedNodeTopic(char *buff, const char *d) {
-    strcpy(buff, _id);
-    strcat(buff, "/");
-    strcat(buff, d);
-
-    //log_v("Prefixed Topic Node: %s", buff);
-    return buff;
-}
-
 bool Node::setup() {
     if (!_name || !_type || !_id) {
         log_e("Node Name, Type or ID isnt set! Name: '%s' Type: '%s' ID: '%s'", _name ? _name : "UNDEFINED", _type ? _type : "UNDEFINED", _id ? _id : "UNDEFINED");
@@ -37,25 +52,22 @@ bool Node::setup() {
 
     log_v("Starting Setup for Node %s (%s)", _name, _id);
 
-    std::unique_ptr<char[]> nodeTopic(new char[strlen(_id) + 13]);
-    // char* nodeTopic = new char[strlen(_id) + 13];// 12 for /$properties and 1 for line end
+    // homie/device/nodeid/$name
+    TopicBuilder topic(_parent.getMaxTopicLength(), _parent.getTopic());
+    topic.appendToBase(_id).appendToBase("/");
 
-    _client.publish(_parent.prefixedTopic(_parent.getWorkingBuffer(), prefixedNodeTopic(nodeTopic.get(), "$name")), 1, true, _name);
-    _client.publish(_parent.prefixedTopic(_parent.getWorkingBuffer(), prefixedNodeTopic(nodeTopic.get(), "$type")), 1, true, _type);
+    _client.publish(topic.with("$name"), _parent.getAttributeQos(), true, _name);
+    _client.publish(topic.with("$type"), _parent.getAttributeQos(), true, _type);
 
-    String propNames((char *)0);
-    // we only assume the max prop name len is 19, in my case it is!
-    propNames.reserve(_properties.size() * 20);
-    for (auto const &prop : _properties) {
-        propNames.concat(prop->getId());
-        propNames.concat(",");
-    }
-    if (_properties.size() > 0)
-        propNames.remove(propNames.length() - 1);
-
-    log_v("PropNames: %s", propNames.c_str());
+    // A declared node brings the list along, unless properties were added to it later on
+    const char *propertyIds = _spec && _spec->propertyCount == _properties.size() ? _spec->propertyIds : nullptr;
+    if (!propertyIds && !_propertiesPayload)
+        _propertiesPayload = joinIds(_properties, _parent.getArena());
+    if (!propertyIds)
+        propertyIds = _propertiesPayload;
+    log_v("PropNames: %s", propertyIds);
 
-    _client.publish(_parent.prefixedTopic(_parent.getWorkingBuffer(), prefixedNodeTopic(nodeTopic.get(), "$properties")), 1, true, propNames.c_str());
+    _client.publish(topic.with("$properties"), _parent.getAttributeQos(), true, propertyIds);
 
     for (auto const &prop : _properties) {
         if (!prop->setup()) {
@@ -63,13 +75,47 @@ bool Node::setup() {
             return false;
         }
     }
+
+    init();
     return true;
 }
 
 void Node::init() {
     log_v("Init for node %s (%s)", _name, _id);
 
+    // All callbacks are in place before the first message on the subscribed topics can arrive
+    _parent.registerSettableProperties(*this);
+    if (_parent.getSubscribeMode() == SUBSCRIBE_PER_TOPIC) {
+        for (auto const &prop : _properties) {
+            prop->init();
+        }
+        return;
+    }
+
+    if (_parent.getSubscribeMode() == SUBSCRIBE_PER_NODE) {
+        // homie/device/nodeid/+ and homie/device/nodeid/+/set
+        TopicBuilder topic(_parent.getMaxTopicLength(), _parent.getTopic());
+        topic.appendToBase(_id).appendToBase("/+");
+        if (hasSettableProperty(true))
+            _client.subscribe(topic.with(""), 1);
+        if (hasSettableProperty(false))
+            _client.subscribe(topic.with("/set"), 1);
+    }
+}
+
+void Node::unsubscribeRestoreFilter() {
+    if (!hasSettableProperty(true))
+        return;
+
+    TopicBuilder topic(_parent.getMaxTopicLength(), _parent.getTopic());
+    topic.appendToBase(_id).appendToBase("/+");
+    _client.unsubscribe(topic.with(""));
+}
+
+bool Node::hasSettableProperty(bool retained) {
     for (auto const &prop : _properties) {
-        prop->init();
+        if (prop->isSettable() && (!retained || prop->isRetained()))
+            return true;
     }
+    return false;
 }
\ No newline at end of file
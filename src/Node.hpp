@@ -1,5 +1,6 @@
 #pragma once
 
+#undef TAG
 #define TAG "Home_Node"
 
 #include <string.h>
@@ -8,6 +9,7 @@
 // #include <MQTT.h>
 #include <AsyncMqttClient.h>
 
+#include <IdList.hpp>
 #include <Property.hpp>
 class Device;
 
@@ -19,22 +21,36 @@ class Node {
     const char *_id;
     const char *_type;
     std::vector<Property *> _properties;
+    // Payload of $properties, built in the arena of the device at the first setup
+    const char *_propertiesPayload = nullptr;
+    // Set if declared with HOMIE_DECLARE_NODE, the $properties payload is taken from it
+    const HomieNodeSpec *_spec = nullptr;
+    uint8_t _callbackLane = 0;
     AsyncMqttClient &_client;
 
-    char *prefixedNodeTopic(char *buff, const char *d);
-
    public:
     Node(Device &src, AsyncMqttClient &client, const char *id);
-    ~Node() {
-        for (auto &&prop : _properties) {
-            delete prop;
-        }
-    };
+
+    /**
+     * @brief Creates the node and its properties from a HOMIE_DECLARE_NODE declaration, without copying its strings.
+     */
+    Node(Device &src, AsyncMqttClient &client, const HomieNodeSpec &spec);
+    ~Node();
 
     bool setup();
 
     void init();
 
+    /**
+     * @brief Unsubscribes the "<node>/+" filter the retained values were restored through, for SUBSCRIBE_PER_NODE.
+     */
+    void unsubscribeRestoreFilter();
+
+    /**
+     * @brief Checks if the node has a settable property, also retained if retained is true.
+     */
+    bool hasSettableProperty(bool retained);
+
     /**
      * @brief This method creates a new Property with the given 
      * name,id,dataType, adds it to the node and returns the property.
@@ -58,18 +74,15 @@ class Node {
         return this->_parent;
     }
 
+    const std::vector<Property *> &getProperties() {
+        return this->_properties;
+    }
+
     const char *getName() {
         return this->_name;
     }
 
-    void setName(const char *name) {
-        if (_name)
-            delete[] _name;
-
-        char *_namebuff = new char[strlen(name) + 1];
-        strcpy(_namebuff, name);
-        _name = _namebuff;
-    }
+    void setName(const char *name);
 
     const char *getId() {
         return this->_id;
@@ -79,12 +92,19 @@ class Node {
         return this->_type;
     }
 
-    void setType(const char *type) {
-        if (_type)
-            delete[] _type;
+    void setType(const char *type);
+
+    /**
+     * @brief Set the lane the set callbacks of this node run on, see CallbackDispatcher.
+     * Nodes are spread round robin over the lanes by default.
+     *
+     * @param lane taken modulo the number of lanes
+     */
+    void setCallbackLane(uint8_t lane) {
+        this->_callbackLane = lane;
+    }
 
-        char *_typebuff = new char[strlen(type) + 1];
-        strcpy(_typebuff, type);
-        _type = _typebuff;
+    uint8_t getCallbackLane() {
+        return this->_callbackLane;
     }
-};
+};
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include <NvsValueStore.hpp>
+#include "MqttLogger.hpp"
+
+bool NvsValueStore::begin() {
+    if (_open)
+        return true;
+
+    esp_err_t err = nvs_open(_namespace, NVS_READWRITE, &_handle);
+    if (err != ESP_OK) {
+        log_e("Unable to open NVS namespace '%s': %s", _namespace, esp_err_to_name(err));
+        return false;
+    }
+    _open = true;
+    return true;
+}
+
+size_t NvsValueStore::read(const char *key, void *buff, size_t size) {
+    size_t len = size;
+    if (!_open || nvs_get_blob(_handle, key, buff, &len) != ESP_OK)
+        return 0;
+    return len;
+}
+
+bool NvsValueStore::write(const char *key, const void *data, size_t len) {
+    if (!_open)
+        return false;
+
+    esp_err_t err = nvs_set_blob(_handle, key, data, len);
+    if (err != ESP_OK) {
+        log_e("Unable to write '%s' to NVS: %s", key, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+bool NvsValueStore::commit() {
+    return _open && nvs_commit(_handle) == ESP_OK;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <nvs.h>
+
+#include <LastValueStore.hpp>
+
+/**
+ * @brief Keeps the last values in the NVS partition, one blob per property.
+ * The cache writes changed values in debounced batches, so a property that changes
+ * every few ms doesnt wear the flash out.
+ *
+ * NvsValueStore store;
+ * device.setLastValueStore(store);
+ */
+class NvsValueStore : public LastValueStore {
+   private:
+    const char *_namespace;
+    nvs_handle _handle = 0;
+    bool _open = false;
+
+   public:
+    /**
+     * @param ns the NVS namespace, at most 15 chars
+     */
+    NvsValueStore(const char *ns = "homie") : _namespace(ns) {}
+
+    ~NvsValueStore() {
+        if (_open)
+            nvs_close(_handle);
+    }
+
+    bool begin() override;
+
+    size_t read(const char *key, void *buff, size_t size) override;
+
+    bool write(const char *key, const void *data, size_t len) override;
+
+    bool commit() override;
+};
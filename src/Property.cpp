@@ -1,6 +1,7 @@
 #include <Device.hpp>
 #include <Node.hpp>
 #include <Property.hpp>
+#include <math.h>
 
 const char *dateTypeEnumToString(HomieDataType type) {
     switch (type) {
@@ -44,30 +45,79 @@ const char *boolToString(bool b) {
     return b ? "true" : "false";
 }
 
-bool isNumeric(const char *s) {
-    if (s == nullptr || *s == '\0' || isspace(*s))
-        return false;
-    char *p;
-    strtod(s, &p);
-    return *p == '\0';
-}
-
 Property::Property(Node &src, AsyncMqttClient &client, const char *id, const char *name, HomieDataType dataType) : _parent(src),
-                                                                                                                   _topic(nullptr),
-                                                                                                                   _topicSet(nullptr),
                                                                                                                    _dataType(dataType),
                                                                                                                    _unit(nullptr),
                                                                                                                    _format(nullptr),
                                                                                                                    _value(nullptr),
                                                                                                                    _client(client) {
-    char *idBuff = new char[strlen(id) + 1];
-    strcpy(idBuff, id);
-    _id = idBuff;
+    ModelArena &arena = src.getParent().getArena();
+    _id = arena.intern(id);
+    _name = arena.intern(name);
 
-    char *nameBuff = new char[strlen(name) + 1];
-    strcpy(nameBuff, id);
-    _name = nameBuff;
+    allocateValue();
+}
+
+Property::Property(Node &src, AsyncMqttClient &client, const HomiePropertySpec &spec) : _parent(src),
+                                                                                        _name(spec.name),
+                                                                                        _id(spec.id),
+                                                                                        _dataType(spec.dataType),
+                                                                                        _settable(spec.settable),
+                                                                                        _retained(spec.retained),
+                                                                                        _unit(spec.unit),
+                                                                                        _format(spec.format),
+                                                                                        _value(nullptr),
+                                                                                        _client(client) {
+    // The topics were generated for a device id, they are only used if it is the id of this device
+    const char *deviceTopic = src.getParent().getTopic();
+    if (strncmp(spec.topic, deviceTopic, strlen(deviceTopic)) == 0)
+        _spec = &spec;
+    else
+        log_w("Property %s was declared for topic '%s', its topics are rendered from the ids", spec.id, spec.topic);
+    allocateValue();
+}
 
+void Property::setUnit(const char *unit) {
+    _unit = _parent.getParent().getArena().intern(unit);
+}
+
+void Property::setFormat(const char *format) {
+    _format = _parent.getParent().getArena().intern(format);
+    // Values set before the device is set up are checked against it, setup() reports a format it cant use
+    _validator.compile(_dataType, _format);
+    if (_dataType == HOMIE_ENUM)
+        setupEnumNode();
+
+    // A default value set before the format gets the native value the format gives it
+    HomieValue native = HomieValue();
+    if (_value[0] && checkValue(_value, native) != VALUE_INVALID) {
+        lockValue();
+        _native = native;
+        unlockValue();
+    }
+}
+
+size_t Property::getTopicLength() {
+    if (_spec)
+        return strlen(_spec->topic);
+    return strlen(_parent.getParent().getTopic()) + strlen(_parent.getId()) + 1 + strlen(_id);
+}
+
+const char *Property::getTopic(char *buff, bool set) {
+    if (_spec)
+        return set ? _spec->topicSet : _spec->topic;
+
+    // homie/device/ + nodeid/propid [+ /set], setup made sure it fits
+    char *end = stpcpy(buff, _parent.getParent().getTopic());
+    end = stpcpy(end, _parent.getId());
+    *end++ = '/';
+    end = stpcpy(end, _id);
+    if (set)
+        strcpy(end, "/set");
+    return buff;
+}
+
+void Property::allocateValue() {
     switch (_dataType) {
         case HOMIE_STRING:
             _valueSize = 201;  // Limit strings to 200chars for now!
@@ -77,57 +127,86 @@ Property::Property(Node &src, AsyncMqttClient &client, const char *id, const cha
             _valueSize = 6;
             break;
         case HOMIE_COLOR:
-            _valueSize = 12;
+            _valueSize = HOMIE_COLOR_TEXT_LEN;
             break;
         case HOMIE_ENUM:
             _valueSize = 16;  // Enums can now have max len of 15 chars!
             break;
-        case HOMIE_UNDEFINED:
         case HOMIE_FLOAT:
+            _valueSize = 25;  // Longest %.17g output
+            break;
+        case HOMIE_UNDEFINED:
         case HOMIE_INT:
-            _valueSize = 20;
+            _valueSize = 21;  // Longest int64_t
             break;
     }
 
-    _value = new char[_valueSize];
+    _value = (char *)_parent.getParent().getArena().allocate(_valueSize, 1);
     _value[0] = 0;
+    _native.intValue = 0;
+    _native.colorValue = {0, 0, 0};
+    _validator.compile(_dataType, _format);
+    if (_dataType == HOMIE_ENUM && _format)
+        setupEnumNode();
 }
 
-char *Property::prefixedPropertyTopic(char *buff, const char *d) {
-    strcpy(buff, _topic);
-    strcat(buff, d);
-
-    //log_v("Prefixed Topic Property: %s", buff);
-    return buff;
+static uint32_t enumHash(const char *value, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (uint8_t)value[i]) * 16777619u;
+    return hash;
 }
 
 void Property::setupEnumNode() {
-    int size = 0;
+    // Built once the format is known, so last values loaded before setup() get their index.
+    // A setup that is repeated after an interrupted restore keeps the table
+    if (_enumValues && _enumFormat == _format)
+        return;
+
+    size_t size = 1;  // Since delimeter is always once less
     const char del = ',';
     for (const char *i = _format; *i; i++) {
         if (*i == del)
             size++;
     }
-    if (size > 0)
-        size++;  // Since delimeter is always once less
+    if (size > UINT8_MAX) {
+        log_e("Property %s (%s) Enum has %d values, only the first %d are used", _name, _id, size, UINT8_MAX);
+        size = UINT8_MAX;
+    }
 
     log_i("Property %s (%s) Enum %s %d", _name, _id, _format, size);
-    if (_format_arr)
-        delete[] _format_arr;
-
-    _format_arr = new const char *[size];
-
-    char *pch;
-    char *copy = strdup(_format);
-    pch = strtok(copy, ",");
-    int j = 0;
-    while (pch != NULL) {
-        char *tmp = new char[strlen(pch) + 1];
-        strcpy(tmp, pch);
-        _format_arr[j++] = tmp;
-        pch = strtok(NULL, ",");
+    // One copy of the format, the delimeters are replaced by terminators so the names can point into it
+    ModelArena &arena = _parent.getParent().getArena();
+    _enumNames = (char *)arena.allocate(strlen(_format) + 1, 1);
+    strcpy(_enumNames, _format);
+    _enumValues = arena.allocateArray<EnumValue>(size);
+    _enumCount = size;
+    _enumFormat = _format;
+
+    char *name = _enumNames;
+    for (size_t i = 0; i < size; i++) {
+        char *end = strchr(name, del);
+        if (end)
+            *end = '\0';
+        size_t len = strlen(name);
+        _enumValues[i] = {name, len, enumHash(name, len)};
+        name += len + 1;
+    }
+
+    // A default value may have been set before the format was known
+    int index = enumIndexOf(_value);
+    _native.enumIndex = index < 0 ? 0 : index;
+}
+
+int Property::enumIndexOf(const char *value) {
+    size_t len = strlen(value);
+    uint32_t hash = enumHash(value, len);
+    for (uint8_t i = 0; i < _enumCount; i++) {
+        if (_enumValues[i].hash == hash && _enumValues[i].len == len && memcmp(_enumValues[i].name, value, len) == 0)
+            return i;
     }
-    free(copy);
+    return -1;
 }
 
 bool Property::setup() {
@@ -138,167 +217,460 @@ bool Property::setup() {
     }
     if (_dataType == HOMIE_ENUM) {
         setupEnumNode();
+    } else if (!_validator.compile(_dataType, _format)) {
+        log_e("Property %s (%s) | Unable to use format '%s', values are only checked against the datatype", _name, _id, _format ? _format : "");
     }
 
     log_v("Starting setup for Property %s (%s)", _name, _id);
 
     Device &device = _parent.getParent();
 
-    //  homie/device/nodeid/propid/$retained
-    char *topic = new char[strlen(device.getTopic()) + strlen(_parent.getId()) + 1 + strlen(_id) + 1];
-    strcpy(topic, device.getTopic());
-    strcat(topic, _parent.getId());
-    strcat(topic, "/");
-    strcat(topic, _id);
-
-    _topic = topic;
-
-    char *topicSet = new char[strlen(_topic) + 4 + 1];
-    strcpy(topicSet, _topic);
-    strcat(topicSet, "/set");
-    _topicSet = topicSet;
+    // Incoming messages longer than that are dropped, and the topics are rendered into buffers of that size
+    if (getTopicLength() + 4 > HOMIE_MAX_TOPIC_LEN) {
+        log_e("Property %s (%s) | Topic is longer than HOMIE_MAX_TOPIC_LEN (%d)", _name, _id, HOMIE_MAX_TOPIC_LEN);
+        return false;
+    }
 
-    _client.publish(prefixedPropertyTopic(device.getWorkingBuffer(), "/$name"), 1, true, _name);
-    _client.publish(prefixedPropertyTopic(device.getWorkingBuffer(), "/$datatype"), 1, true, dateTypeEnumToString(_dataType));
-    _client.publish(prefixedPropertyTopic(device.getWorkingBuffer(), "/$settable"), 1, true, boolToString(_settable));
-    _client.publish(prefixedPropertyTopic(device.getWorkingBuffer(), "/$retained"), 1, true, boolToString(_retained));
+    char topic[HOMIE_MAX_TOPIC_LEN + 1];
+    TopicBuilder attributeTopic(device.getMaxTopicLength(), getTopic(topic));
+    _client.publish(attributeTopic.with("/$name"), device.getAttributeQos(), true, _name);
+    _client.publish(attributeTopic.with("/$datatype"), device.getAttributeQos(), true, dateTypeEnumToString(_dataType));
+    _client.publish(attributeTopic.with("/$settable"), device.getAttributeQos(), true, boolToString(_settable));
+    _client.publish(attributeTopic.with("/$retained"), device.getAttributeQos(), true, boolToString(_retained));
 
     if (_unit)
-        _client.publish(prefixedPropertyTopic(device.getWorkingBuffer(), "/$unit"), 1, true, _unit);
+        _client.publish(attributeTopic.with("/$unit"), device.getAttributeQos(), true, _unit);
 
     if (_format)
-        _client.publish(prefixedPropertyTopic(device.getWorkingBuffer(), "/$format"), 1, true, _format);
+        _client.publish(attributeTopic.with("/$format"), device.getAttributeQos(), true, _format);
 
-    init();
+    _setUp = true;
     return true;
 }
 
 void Property::init() {
-    log_v("Init for property %s (%s) with base topic: '%s'", _name, _id, _topic);
+    char topic[HOMIE_MAX_TOPIC_LEN + 1];
+    log_v("Init for property %s (%s) with base topic: '%s'", _name, _id, getTopic(topic));
 
     if (_retained)
-        _client.subscribe(_topic, 1);
+        _client.subscribe(getTopic(topic), 1);
 
-    if (_settable) {
-        _parent.getParent().registerSettableProperty(*this);
-        _client.subscribe(prefixedPropertyTopic(_parent.getParent().getWorkingBuffer(), "/set"), 1);
-    }
+    if (_settable)
+        _client.subscribe(getTopic(topic, true), 1);
 }
 
-void Property::setValue(const char *value, bool updateToMqtt) {
-    if (!validateValue(value)) {
-        if (_dataType == HOMIE_ENUM) {
-            value = _format_arr[0];
-        } else
-            value = defaultForDataType(_dataType);
+// Writes value as decimal text to dst, returns the position of the terminating null
+static char *formatInt(char *dst, int64_t value) {
+    uint64_t digits = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    char reversed[20];
+    int len = 0;
+    do {
+        reversed[len++] = '0' + digits % 10;
+        digits /= 10;
+    } while (digits);
+    if (value < 0)
+        *dst++ = '-';
+    while (len)
+        *dst++ = reversed[--len];
+    *dst = '\0';
+    return dst;
+}
+
+// Gives a writer that was preempted by the waiting task the chance to finish
+static void waitForWriter(uint32_t &spins) {
+    if (++spins < HOMIE_VALUE_SPINS)
+        return;
+    spins = 0;
+    vTaskDelay(1);
+}
+
+void Property::lockValue() {
+    uint32_t spins = 0;
+    uint32_t seq = __atomic_load_n(&_valueSeq, __ATOMIC_RELAXED);
+    while ((seq & 1) || !__atomic_compare_exchange_n(&_valueSeq, &seq, seq + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        waitForWriter(spins);
+        seq = __atomic_load_n(&_valueSeq, __ATOMIC_RELAXED);
     }
+    // Readers that see any of the writes below also see the odd sequence
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void Property::unlockValue() {
+    __atomic_add_fetch(&_valueSeq, 1, __ATOMIC_RELEASE);
+}
 
-    // This is a correction incase the RGB values where send as floats -- OpenHab specific IMPL/fix
-    if (_dataType == HOMIE_COLOR) {
-        float h, s, v;
-        sscanf(value, "%a,%a,%a", &h, &s, &v);
-        sprintf(_value, "%.0f,%.0f,%.0f", h, s, v);
-        value = _value;
+HomieValue Property::readNative() {
+    uint32_t spins = 0;
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&_valueSeq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1)) {
+            HomieValue native = _native;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&_valueSeq, __ATOMIC_RELAXED) == seq)
+                return native;
+        }
+        waitForWriter(spins);
     }
+}
+
+void Property::reserveValue(size_t len) {
+    if (len <= (_valueSize - 1))
+        return;
+
+    log_e("value length was bigger than buffer! Allocating bigger Buffer! old:new -> '%i':'%i'", _valueSize, len + 1);
+    ModelArena &arena = _parent.getParent().getArena();
+    arena.release(_value);
+    _valueSize = len + 1;
+    _value = (char *)arena.allocate(_valueSize, 1);
+}
 
-    if (strlen(value) > (_valueSize - 1)) {
-        log_e("value '%s' length was bigger than buffer! Allocating bigger Buffer! old:new -> '%i':'%i'", value, _valueSize, strlen(value) + 1);
-        if (_value)
-            delete[] _value;
-        _valueSize = strlen(value) + 1;
-        _value = new char[_valueSize];
+void Property::storeValue(const char *value, const HomieValue &native, bool keepText) {
+    _native = native;
+    _parent.getParent().getLastValueCache().changed(*this);
+    if (!keepText) {
+        __atomic_store_n(&_valueFormatted, false, __ATOMIC_RELEASE);
+        return;
     }
-    if (_value != value) {
-        strcpy(_value, value);
+
+    if (_value == value) {
+        log_d("Values are equal for %s (%s)", _name, _id);
     } else {
-        log_i("Values are equal for %s at: %s", _name, _topic);
+        reserveValue(strlen(value));
+        strcpy(_value, value);
+    }
+    __atomic_store_n(&_valueFormatted, true, __ATOMIC_RELEASE);
+}
+
+void Property::storeNative(const HomieValue &native) {
+    _native = native;
+    _parent.getParent().getLastValueCache().changed(*this);
+    __atomic_store_n(&_valueFormatted, false, __ATOMIC_RELEASE);
+}
+
+const char *Property::formatValue() {
+    if (__atomic_load_n(&_valueFormatted, __ATOMIC_ACQUIRE))
+        return _value;
+
+    switch (_dataType) {
+        case HOMIE_INT:
+            formatInt(_value, _native.intValue);
+            break;
+        case HOMIE_FLOAT:
+            // Shortest of the two precisions that reads back as the same double
+            snprintf(_value, _valueSize, "%.15g", _native.floatValue);
+            if (strtod(_value, nullptr) != _native.floatValue)
+                snprintf(_value, _valueSize, "%.17g", _native.floatValue);
+            break;
+        case HOMIE_BOOL:
+            strcpy(_value, boolToString(_native.boolValue));
+            break;
+        case HOMIE_ENUM:
+            if (_native.enumIndex < _enumCount) {
+                reserveValue(_enumValues[_native.enumIndex].len);
+                strcpy(_value, _enumValues[_native.enumIndex].name);
+            }
+            break;
+        case HOMIE_COLOR:
+            ColorCodec::format(_value, _native.colorValue);
+            break;
+        default:
+            break;
     }
+    __atomic_store_n(&_valueFormatted, true, __ATOMIC_RELEASE);
+    return _value;
+}
+
+const char *Property::getValue() {
+    if (!__atomic_load_n(&_valueFormatted, __ATOMIC_ACQUIRE)) {
+        lockValue();
+        formatValue();
+        unlockValue();
+    }
+    return _value;
+}
+
+// FNV-1a, 64 bit so distinct strings practically never compare as unchanged
+static int64_t textHash(const char *text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *text; text++)
+        hash = (hash ^ (uint8_t)*text) * 1099511628211ULL;
+    return (int64_t)hash;
+}
+
+bool Property::needsPublish(const HomieValue &native, const char *value) {
+    if (!_retained || !_skipUnchanged || !_hasReported)
+        return true;
+
+    bool unchanged;
+    switch (_dataType) {
+        case HOMIE_INT:
+            // Through double, int64 values above 2^53 would compare as equal
+            if (_deadband == 0)
+                unchanged = native.intValue == _reported.intValue;
+            else
+                unchanged = fabs((double)native.intValue - (double)_reported.intValue) <= _deadband;
+            break;
+        case HOMIE_FLOAT:
+            unchanged = fabs(native.floatValue - _reported.floatValue) <= _deadband;
+            break;
+        case HOMIE_BOOL:
+            unchanged = native.boolValue == _reported.boolValue;
+            break;
+        case HOMIE_ENUM:
+            unchanged = native.enumIndex == _reported.enumIndex;
+            break;
+        case HOMIE_COLOR:
+            unchanged = native.colorValue.h == _reported.colorValue.h && native.colorValue.s == _reported.colorValue.s &&
+                        native.colorValue.v == _reported.colorValue.v;
+            break;
+        default:
+            unchanged = value && textHash(value) == _reported.intValue;
+            break;
+    }
+
+    if (!unchanged || (_heartbeatInterval && millis() - _lastPublished >= _heartbeatInterval))
+        return true;
 
-    log_i("Property %s(%s) topic->'%s' payload->'%s:::%p' bufferValue->'%s:::%p' ", _name, _id, _topic, value, &value, _value, &_value);
+    _parent.getParent().getPublishScheduler().countSuppressed();
+    return false;
+}
+
+HomieValue Property::reportValue() {
+    switch (_dataType) {
+        case HOMIE_INT:
+        case HOMIE_FLOAT:
+        case HOMIE_BOOL:
+        case HOMIE_ENUM:
+        case HOMIE_COLOR:
+            return _native;
+        default: {
+            HomieValue reported;
+            reported.intValue = textHash(formatValue());
+            return reported;
+        }
+    }
+}
+
+void Property::publishValue(bool updateToMqtt) {
+    log_d("Property %s(%s) value->'%s'", _name, _id, getValue());
     if (!_retained)
         return;
-    if (updateToMqtt)
-        _client.publish(prefixedPropertyTopic(_parent.getParent().getWorkingBuffer(), "/set"), 1, true, _value);
-    else
-        _client.publish(_topic, 1, true, _value);
+    if (updateToMqtt) {
+        char topic[HOMIE_MAX_TOPIC_LEN + 1];
+        _client.publish(getTopic(topic, true), 1, true, getValue());
+    } else {
+        _parent.getParent().getPublishScheduler().publish(*this);
+    }
+}
+
+void Property::valuePublished(const HomieValue &reported) {
+    // A value that failed to publish isnt reported, so setting it again is retried
+    lockValue();
+    _reported = reported;
+    _hasReported = true;
+    unlockValue();
+    _parent.getParent().getLastValueCache().published(*this);
+}
+
+ValidationResult Property::checkValue(const char *value, HomieValue &native) {
+    if (!value || *value == '\0')
+        return VALUE_INVALID;
+
+    if (_dataType == HOMIE_ENUM) {
+        int index = enumIndexOf(value);
+        if (index < 0)
+            return VALUE_INVALID;
+        native.enumIndex = index;
+        return VALUE_VALID;
+    }
+    return _validator.check(value, native);
+}
+
+void Property::setValue(const char *value, bool updateToMqtt) {
+    HomieValue native = HomieValue();
+    ValidationResult result = checkValue(value, native);
+    if (result == VALUE_INVALID) {
+        native = HomieValue();
+        if (_dataType == HOMIE_ENUM && _enumCount) {
+            value = _enumValues[0].name;
+        } else
+            value = defaultForDataType(_dataType);
+    }
+
+    // Colors are always formatted again, to get rid of float components
+    bool keepText = result != VALUE_CLAMPED && _dataType != HOMIE_COLOR;
+
+    lockValue();
+    bool publish = updateToMqtt || needsPublish(native, value);
+    storeValue(value, native, keepText);
+    unlockValue();
+
+    if (publish)
+        publishValue(updateToMqtt);
 }
 
 void Property::setValue(String value, bool updateToMqtt) {
     setValue(value.c_str(), updateToMqtt);
 }
 
+void Property::setNativeValue(HomieValue native, bool updateToMqtt) {
+    ValidationResult result = _validator.check(native);
+    if (result == VALUE_INVALID) {
+        log_w("Property %s (%s) | Value doesnt match the format '%s', using the default value", _name, _id, _format ? _format : "");
+        native = HomieValue();
+    }
+
+    lockValue();
+    bool publish = updateToMqtt || needsPublish(native, nullptr);
+    storeNative(native);
+    unlockValue();
+
+    if (publish)
+        publishValue(updateToMqtt);
+}
+
 void Property::setValue(int value, bool updateToMqtt) {
-    setValue(String(value).c_str(), updateToMqtt);
+    setValue((long long)value, updateToMqtt);
+}
+
+void Property::setValue(long value, bool updateToMqtt) {
+    setValue((long long)value, updateToMqtt);
+}
+
+void Property::setValue(long long value, bool updateToMqtt) {
+    HomieValue native;
+    if (_dataType == HOMIE_INT) {
+        native.intValue = value;
+    } else if (_dataType == HOMIE_FLOAT) {
+        native.floatValue = value;
+    } else {
+        char buff[24];
+        formatInt(buff, value);
+        setValue(buff, updateToMqtt);
+        return;
+    }
+    setNativeValue(native, updateToMqtt);
+}
+
+void Property::setValue(double value, bool updateToMqtt) {
+    HomieValue native;
+    if (_dataType == HOMIE_FLOAT) {
+        native.floatValue = value;
+    } else if (_dataType == HOMIE_INT) {
+        native.intValue = (int64_t)value;
+    } else {
+        char buff[32];
+        snprintf(buff, sizeof(buff), "%.15g", value);
+        setValue(buff, updateToMqtt);
+        return;
+    }
+    setNativeValue(native, updateToMqtt);
 }
 
 void Property::setValue(bool value, bool updateToMqtt) {
-    setValue(boolToString(value), updateToMqtt);
+    if (_dataType != HOMIE_BOOL) {
+        setValue(boolToString(value), updateToMqtt);
+        return;
+    }
+
+    HomieValue native;
+    native.boolValue = value;
+    setNativeValue(native, updateToMqtt);
+}
+
+void Property::setValue(const HomieColor &value, bool updateToMqtt) {
+    if (_dataType != HOMIE_COLOR) {
+        char buff[HOMIE_COLOR_TEXT_LEN];
+        ColorCodec::format(buff, value);
+        setValue(buff, updateToMqtt);
+        return;
+    }
+
+    HomieValue native;
+    native.colorValue = value;
+    setNativeValue(native, updateToMqtt);
 }
 
 bool Property::validateValue(const char *value) {
-    if (!value || strlen(value) == 0)
-        return false;
+    HomieValue native;
+    return checkValue(value, native) != VALUE_INVALID;
+}
 
-    switch (_dataType) {
-        case HOMIE_BOOL:
-            if (strcmp(_value, "true") != 0 && strcmp(_value, "false") != 0)
-                return false;
-            break;
-        case HOMIE_COLOR:
-            if (!_format) {
-                log_e("Error, no format for color given of property: %s, unable to validate value. Falling back to default value", _name);
-                return false;
-            }
+void Property::setEnumIndex(uint8_t index, bool updateToMqtt) {
+    if (_dataType != HOMIE_ENUM || index >= _enumCount) {
+        log_e("Property %s (%s) has no enum value at index %d", _name, _id, index);
+        return;
+    }
 
-            float h, s, v;
-            if (sscanf(value, "%a,%a,%a", &h, &s, &v) == EOF) {
-                return false;
-            }
-            if (h < 0 || s < 0 || v < 0) {
-                return false;
-            }
+    HomieValue native;
+    native.enumIndex = index;
+    setNativeValue(native, updateToMqtt);
+}
 
-            break;
-        case HOMIE_ENUM:
-            if (!strstr(_format, _value)) {
-                return false;
-            }
-            break;
+int Property::getValueAsInt() {
+    return (int)getValueAsLong();
+}
+
+long Property::getValueAsLong() {
+    switch (_dataType) {
         case HOMIE_INT:
-            if (!isNumeric(value)) {
-                return false;
-            }
-            break;
+            return (long)readNative().intValue;
         case HOMIE_FLOAT:
-            log_w("Float validation not implemented yet!");
-            break;
-
-        case HOMIE_STRING:
-            log_w("String validation not implemented yet!");
-            break;
+            return (long)readNative().floatValue;
+        case HOMIE_BOOL:
+            return readNative().boolValue;
+        default:
+            return atol(getValue());
+    }
+}
 
+double Property::getValueAsDouble() {
+    switch (_dataType) {
+        case HOMIE_INT:
+            return (double)readNative().intValue;
+        case HOMIE_FLOAT:
+            return readNative().floatValue;
+        case HOMIE_BOOL:
+            return readNative().boolValue;
         default:
-            return false;
+            return atof(getValue());
     }
-    return true;
 }
 
-int Property::getValueAsInt() {
-    return atoi(_value);
+HomieColor Property::getValueAsColor() {
+    if (_dataType == HOMIE_COLOR)
+        return readNative().colorValue;
+
+    HomieColor color = {0, 0, 0};
+    ColorCodec::parse(getValue(), color);
+    return color;
 }
 
-long Property::getValueAsLong() {
-    return atol(_value);
+HomieColor Property::getValueAsRgb() {
+    HomieColor color = getValueAsColor();
+    return getColorSpace() == COLOR_HSV ? ColorCodec::hsvToRgb(color) : color;
+}
+
+HomieColor Property::getValueAsHsv() {
+    HomieColor color = getValueAsColor();
+    return getColorSpace() == COLOR_RGB ? ColorCodec::rgbToHsv(color) : color;
 }
 
 bool Property::getValueAsBool() {
-    return strcmp(_value, "true") == 0;
+    if (_dataType == HOMIE_BOOL)
+        return readNative().boolValue;
+    return strcmp(getValue(), "true") == 0;
 }
 
 void Property::setDefaultValue(const char *value) {
-    if (_retained)
-        strcpy(_value, value);
-    else
+    if (_retained) {
+        // A value that doesnt pass yet because its format is set later is kept as text, setFormat() checks it again
+        HomieValue native = HomieValue();
+        ValidationResult result = checkValue(value, native);
+        lockValue();
+        storeValue(value, native, result == VALUE_INVALID || (result == VALUE_VALID && _dataType != HOMIE_COLOR));
+        unlockValue();
+    } else
         log_e("Property: %s (%s) | A non retained Property should never have a default value!", _name, _id);
 }
 
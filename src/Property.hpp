@@ -2,6 +2,7 @@
 
 #include "MqttLogger.hpp"
 
+#undef TAG
 #define TAG "Home_Property"
 
 #include <string.h>
@@ -9,10 +10,21 @@
 #include <AsyncMqttClient.h>
 
 #include <HomieDatatype.hpp>
+#include <HomieModel.hpp>
+#include <MessagePool.hpp>
+#include <ValueValidator.hpp>
 
 class Node;
 class Property;
 
+// Property::getIndex() of a property that isnt set up yet
+#define HOMIE_NO_PROPERTY_INDEX UINT16_MAX
+
+// Times a task spins on the value of a property another task is writing, before it sleeps a tick
+#ifndef HOMIE_VALUE_SPINS
+#define HOMIE_VALUE_SPINS 64
+#endif
+
 // The callback function receives the received MQTT payload, if it wishes to modify the property e.g. custom format return sth. or just the payload again if nothing changed!
 typedef std::function<String(Property &property, const char *payload)> PropertySetCallback;
 
@@ -21,29 +33,100 @@ const char *defaultForDataType(HomieDataType type);
 class Property {
    private:
     Node &_parent;
-    const char *_topic;
-    const char *_topicSet;
 
+    // Strings live in the ModelArena of the device, the topics are rendered from the ids when needed
     const char *_name;
     const char *_id;
     HomieDataType _dataType = HOMIE_UNDEFINED;
     bool _settable = false;
     bool _retained = true;
+    uint8_t _qos = 1;
     const char *_unit;
     const char *_format;
-    const char **_format_arr = nullptr;
+    // Set if declared with HOMIE_DECLARE_NODE for this device, the topics are taken from it
+    const HomiePropertySpec *_spec = nullptr;
+    bool _setUp = false;
+    // Dense index within the device, assigned by the TopicIndex at setup
+    uint16_t _index = HOMIE_NO_PROPERTY_INDEX;
+    friend class TopicIndex;
+
+    // Exact match table of the enum values, built once from _format
+    struct EnumValue {
+        const char *name;
+        size_t len;
+        uint32_t hash;
+    };
+    EnumValue *_enumValues = nullptr;
+    char *_enumNames = nullptr;
+    const char *_enumFormat = nullptr;
+    uint8_t _enumCount = 0;
     PropertySetCallback _callback;
 
+    // Homie text form of the value, in the arena of the device
     char *_value = nullptr;
     size_t _valueSize;
 
+    // Native form of the value, the member in use depends on _dataType. Typed setters only write
+    // here, _value is formatted from it when the text is needed, e.g. for the next publish.
+    HomieValue _native;
+    bool _valueFormatted = true;
+
+    ValueValidator _validator;
+
+    // Seqlock of the value, odd while a task writes it. Guards _value, _native, _valueFormatted and the
+    // change detection state. Writers of different properties never wait for each other, readers of the
+    // native value dont write at all and retry if a writer got in between.
+    uint32_t _valueSeq = 0;
+
+    // Change detection, _reported is the value the client last accepted, see reportValue()
+    HomieValue _reported;
+    bool _hasReported = false;
+    bool _skipUnchanged = true;
+    double _deadband = 0;
+    uint32_t _heartbeatInterval = 0;
+
+    // Publish state, owned by the PublishScheduler of the device
+    uint32_t _publishInterval = 0;
+    unsigned long _lastPublished = 0;
+    bool _publishPending = false;
+    friend class PublishScheduler;
+    friend class LastValueCache;
+
     AsyncMqttClient &_client;
 
-    char *prefixedPropertyTopic(char *buff, const char *d);
+    void allocateValue();
     void setupEnumNode();
+    int enumIndexOf(const char *value);
+
+    ValidationResult checkValue(const char *value, HomieValue &native);
+
+    // The value is only written between lockValue() and unlockValue(), they dont nest
+    void lockValue();
+    void unlockValue();
+    // Consistent copy of the native value, without taking the lock
+    HomieValue readNative();
+
+    // These have to be called with the value locked
+    void reserveValue(size_t len);
+    void storeValue(const char *value, const HomieValue &native, bool keepText);
+    void storeNative(const HomieValue &native);
+    const char *formatValue();
+
+    void setNativeValue(HomieValue native, bool updateToMqtt);
+
+    // Has to be called with the value locked, before the new value is stored
+    bool needsPublish(const HomieValue &native, const char *value);
+    // What the change detection compares, the native value or a hash of the text of strings. Has to be called with the value locked.
+    HomieValue reportValue();
+
+    void publishValue(bool updateToMqtt);
+
+    // Called by the PublishScheduler once the client accepted the value, reported is reportValue() of what was sent
+    void valuePublished(const HomieValue &reported);
 
    public:
     Property(Node &src, AsyncMqttClient &client, const char *id, const char *name, HomieDataType dataType);
+    Property(Node &src, AsyncMqttClient &client, const HomiePropertySpec &spec);
     ~Property() {}
 
     bool setup();
@@ -54,11 +137,27 @@ class Property {
      * return true if the value is correct!
      * Does CHECK for null/empty value!!!
      * @param value 
-     * @return true value matches the Format
+     * @return true value matches the Format, or can be clamped to it
      * @return false value does not match the Format
      */
     bool validateValue(const char *value);
 
+    /**
+     * @brief Correct values outside of the $format range (or between its steps) to the nearest allowed value,
+     * instead of falling back to the default value.
+     */
+    void setClampToFormat(bool clamp) {
+        this->_validator.setClamp(clamp);
+    }
+
+    bool isClampToFormat() {
+        return this->_validator.isClamp();
+    }
+
+    Node &getParent() {
+        return this->_parent;
+    }
+
     const char *getName() {
         return this->_name;
     }
@@ -87,49 +186,153 @@ class Property {
         this->_retained = retained;
     }
 
-    const char *getUnit() {
-        return this->_unit;
+    /**
+     * @brief QoS the value is published to the data topic with. Values sent to the set topic
+     * and the subscriptions stay at QoS 1.
+     *
+     * @param qos 0 for high rate telemetry that doesnt need a PUBACK for every value
+     */
+    void setQos(uint8_t qos) {
+        this->_qos = qos > 2 ? 2 : qos;
     }
 
-    void setUnit(const char *unit) {
-        if (_unit)
-            delete[] _unit;
+    uint8_t getQos() {
+        return this->_qos;
+    }
 
-        char *_unitbuff = new char[strlen(unit) + 1];
-        strcpy(_unitbuff, unit);
-        _unit = _unitbuff;
+    const char *getUnit() {
+        return this->_unit;
     }
 
+    void setUnit(const char *unit);
+
     const char *getFormat() {
         return this->_format;
     }
 
-    void setFormat(const char *format) {
-        if (_format)
-            delete[] _format;
+    /**
+     * @brief Set the $format, values are checked against it from now on and a value set before gets its native value.
+     */
+    void setFormat(const char *format);
+
+    /**
+     * @brief Length of the data topic homie/<device>/<node>/<property>, the set topic is 4 chars longer.
+     */
+    size_t getTopicLength();
+
+    /**
+     * @brief Renders the data topic, or the set topic, of the property.
+     *
+     * @param buff receives the topic, has to hold HOMIE_MAX_TOPIC_LEN + 1 chars
+     * @param set true for the set topic
+     * @return const char* buff, or the topic of the declaration if the property was declared with HOMIE_DECLARE_NODE
+     */
+    const char *getTopic(char *buff, bool set = false);
+
+    /**
+     * @brief Checks if setup() was done, before that the value isnt published
+     */
+    bool isSetUp() {
+        return this->_setUp;
+    }
+
+    /**
+     * @brief Index of the property within the device, 0 .. Device::getPropertyCount() - 1.
+     * Assigned at setup in the order the nodes and properties were added, HOMIE_NO_PROPERTY_INDEX before.
+     */
+    uint16_t getIndex() {
+        return this->_index;
+    }
 
-        char *_formatbuff = new char[strlen(format) + 1];
-        strcpy(_formatbuff, format);
-        _format = _formatbuff;
+    /**
+     * @brief Set the minimum time between two publishes of the value.
+     * Values set in between are coalesced, only the latest one is published once the interval passed.
+     *
+     * @param interval in ms, 0 publishes every value right away
+     */
+    void setPublishInterval(uint32_t interval) {
+        this->_publishInterval = interval;
+    }
+
+    uint32_t getPublishInterval() {
+        return this->_publishInterval;
     }
 
-    const char *getTopic() {
-        return this->_topic;
+    /**
+     * @brief By default a value equal to the last published one isnt published again.
+     *
+     * @param skip false publishes every value that is set
+     */
+    void setSkipUnchanged(bool skip) {
+        this->_skipUnchanged = skip;
     }
 
-    const char *getTopicSet() {
-        return this->_topicSet;
+    bool isSkipUnchanged() {
+        return this->_skipUnchanged;
     }
 
+    /**
+     * @brief Integer and float values that differ less than deadband from the last published value count as unchanged.
+     */
+    void setDeadband(double deadband) {
+        this->_deadband = deadband;
+    }
+
+    double getDeadband() {
+        return this->_deadband;
+    }
+
+    /**
+     * @brief Publish an unchanged value anyway, once nothing was published for the interval.
+     *
+     * @param interval in ms, 0 never republishes an unchanged value
+     */
+    void setHeartbeatInterval(uint32_t interval) {
+        this->_heartbeatInterval = interval;
+    }
+
+    uint32_t getHeartbeatInterval() {
+        return this->_heartbeatInterval;
+    }
+
+    /**
+     * @brief The typed getters read the native value without parsing any text,
+     * other data types fall back to converting getValue().
+     */
     int getValueAsInt();
 
     long getValueAsLong();
 
+    double getValueAsDouble();
+
     bool getValueAsBool();
 
-    const char *getValue() {
-        return this->_value;
+    /**
+     * @brief Components of a color value as they are sent, h,s,v or r,g,b depending on the $format.
+     */
+    HomieColor getValueAsColor();
+
+    /**
+     * @brief Color value converted to r,g,b (0-255) if the $format is hsv.
+     */
+    HomieColor getValueAsRgb();
+
+    /**
+     * @brief Color value converted to h,s,v (0-360, 0-100, 0-100) if the $format is rgb.
+     */
+    HomieColor getValueAsHsv();
+
+    /**
+     * @brief Color space of a color property, known once its format is set.
+     */
+    HomieColorSpace getColorSpace() {
+        return this->_validator.getColorSpace();
     }
+
+    /**
+     * @brief Homie text form of the value, formatted on first use after a typed setValue().
+     */
+    const char *getValue();
     /**
      * @brief Set the Value of the Property,
      * if updateToMqtt is set to TRUE it will publish to the SET channel,
@@ -152,10 +355,51 @@ class Property {
      */
     void setValue(String value, bool updateToMqtt = false);
 
+    /**
+     * @brief Typed setters store the native value of integer and float properties without any text,
+     * the text form is only formatted once it gets published.
+     */
     void setValue(int value, bool updateToMqtt = false);
 
+    void setValue(long value, bool updateToMqtt = false);
+
+    void setValue(long long value, bool updateToMqtt = false);
+
+    void setValue(double value, bool updateToMqtt = false);
+
     void setValue(bool value, bool updateToMqtt = false);
 
+    /**
+     * @brief Set a color value, the components have to match the $format of the property (h,s,v or r,g,b).
+     */
+    void setValue(const HomieColor &value, bool updateToMqtt = false);
+
+    /**
+     * @brief Set the value of an enum property by its position in the $format list.
+     *
+     * @param index of the value, the first value of the format is 0
+     * @param updateToMqtt false= Normal-Channel, true= Set-Channel e.g. homie/foo/bar/set
+     */
+    void setEnumIndex(uint8_t index, bool updateToMqtt = false);
+
+    /**
+     * @brief Position of the current value in the $format list of an enum property.
+     */
+    uint8_t getEnumIndex() {
+        return readNative().enumIndex;
+    }
+
+    uint8_t getEnumCount() {
+        return this->_enumCount;
+    }
+
+    /**
+     * @brief Name of the enum value at index, nullptr if there is none
+     */
+    const char *getEnumName(uint8_t index) {
+        return index < _enumCount ? _enumValues[index].name : nullptr;
+    }
+
     void setDefaultValue(const char *value);
 
     void setDefaultValue(String value);
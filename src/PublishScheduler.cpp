@@ -0,0 +1,207 @@
+#include <limits.h>
+
+#include <string>
+
+#include <Property.hpp>
+#include <PublishScheduler.hpp>
+
+PublishScheduler::PublishScheduler(AsyncMqttClient &client) : _client(client) {
+    _lock = xSemaphoreCreateMutex();
+    _wake = xSemaphoreCreateBinary();
+
+    xTaskCreateUniversal(
+        this->publishTaskCode,
+        "homie_publish",
+        4096,
+        this,
+        1,
+        &_task,
+        CONFIG_HOMIE_PUBLISH_RUNNING_CORE);
+}
+
+void PublishScheduler::reserve(size_t properties) {
+    lock();
+    _dirty.reserve(properties);
+    _batch.reserve(properties);
+    unlock();
+}
+
+void PublishScheduler::lock() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+}
+
+void PublishScheduler::unlock() {
+    xSemaphoreGive(_lock);
+}
+
+size_t PublishScheduler::getPendingCount() {
+    lock();
+    size_t pending = _dirty.size() + _batch.size();
+    unlock();
+    return pending;
+}
+
+void PublishScheduler::setRateLimit(uint16_t publishesPerSecond) {
+    lock();
+    _rateLimit = publishesPerSecond;
+    _budget = publishesPerSecond * 1000;
+    _lastRefill = millis();
+    unlock();
+}
+
+void PublishScheduler::hold() {
+    _held = true;
+}
+
+void PublishScheduler::release() {
+    _held = false;
+    xSemaphoreGive(_wake);
+}
+
+bool PublishScheduler::markDirty(Property &property) {
+    // The flush clears the flag before it reads the value, so a value stored before it is still set is published
+    if (__atomic_load_n(&property._publishPending, __ATOMIC_ACQUIRE))
+        return false;
+
+    lock();
+    bool added = !__atomic_load_n(&property._publishPending, __ATOMIC_RELAXED);
+    if (added) {
+        __atomic_store_n(&property._publishPending, true, __ATOMIC_RELEASE);
+        _dirty.push_back(&property);
+    }
+    unlock();
+    return added;
+}
+
+void PublishScheduler::publish(Property &property) {
+    // Values set before the property was set up or while the device is offline wait in the batch like the rate limited ones
+    if (property._publishInterval == 0 && _rateLimit == 0 && property.isSetUp() && !_held) {
+        char topic[HOMIE_MAX_TOPIC_LEN + 1];
+        char inlineValue[INLINE_VALUE_LEN];
+        std::string longValue;
+        // Copied under the lock, a concurrent setValue may rewrite or reallocate the buffer once it is released
+        property.lockValue();
+        const char *value = property.formatValue();
+        size_t len = strlen(value) + 1;
+        if (len <= INLINE_VALUE_LEN) {
+            memcpy(inlineValue, value, len);
+            value = inlineValue;
+        } else {
+            longValue.assign(value, len - 1);
+            value = longValue.c_str();
+        }
+        HomieValue reported = property.reportValue();
+        property.unlockValue();
+        if (_client.publish(property.getTopic(topic), property.getQos(), true, value)) {
+            property.valuePublished(reported);
+            property._lastPublished = millis();
+            __atomic_add_fetch(&_published, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        // Not taken by the client, e.g. the connection just dropped. It is retried until it is.
+    }
+
+    // The task already knows about a pending property
+    if (markDirty(property))
+        xSemaphoreGive(_wake);
+    else
+        __atomic_add_fetch(&_coalesced, 1, __ATOMIC_RELAXED);
+}
+
+void PublishScheduler::refillBudget(unsigned long now) {
+    uint32_t max = _rateLimit * 1000;
+    unsigned long elapsed = now - _lastRefill;
+    _lastRefill = now;
+    if (elapsed >= 1000 || _budget + elapsed * _rateLimit >= max)
+        _budget = max;
+    else
+        _budget += elapsed * _rateLimit;
+}
+
+TickType_t PublishScheduler::flush() {
+    lock();
+    _batch.swap(_dirty);
+    unlock();
+
+    if (_batch.empty())
+        return portMAX_DELAY;
+
+    unsigned long now = millis();
+    uint16_t rateLimit = _rateLimit;
+    if (rateLimit)
+        refillBudget(now);
+
+    bool online = _client.connected() && !_held;
+    unsigned long nextDue = online ? ULONG_MAX : HOMIE_PUBLISH_RETRY_MS;
+    char topic[HOMIE_MAX_TOPIC_LEN + 1];
+    size_t kept = 0;
+    for (auto const &p : _batch) {
+        unsigned long sincePublished = now - p->_lastPublished;
+        unsigned long wait = 0;
+        if (!online || !p->isSetUp()) {
+            wait = HOMIE_PUBLISH_RETRY_MS;
+        } else if (p->_lastPublished != 0 && sincePublished < p->_publishInterval) {
+            wait = p->_publishInterval - sincePublished;
+        } else if (rateLimit && _budget < 1000) {
+            wait = (1000 - _budget + rateLimit - 1) / rateLimit;
+        }
+
+        if (wait) {
+            _batch[kept++] = p;
+            nextDue = min(nextDue, wait);
+            continue;
+        }
+
+        // Whatever was set last is published, the value is formatted and copied so setValue doesnt have to wait for the client.
+        // A value stored after the flag was cleared marks the property dirty again.
+        __atomic_store_n(&p->_publishPending, false, __ATOMIC_SEQ_CST);
+        p->lockValue();
+        const char *value = p->formatValue();
+        size_t len = strlen(value) + 1;
+        if (_payload.size() < len)
+            _payload.resize(len);
+        memcpy(_payload.data(), value, len);
+        HomieValue reported = p->reportValue();
+        p->unlockValue();
+
+        if (!_client.publish(p->getTopic(topic), p->getQos(), true, _payload.data())) {
+            // Retried unless it became dirty again meanwhile, then it is in _dirty already
+            lock();
+            if (!__atomic_load_n(&p->_publishPending, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&p->_publishPending, true, __ATOMIC_RELEASE);
+                _batch[kept++] = p;
+            }
+            unlock();
+            nextDue = min(nextDue, (unsigned long)HOMIE_PUBLISH_RETRY_MS);
+            continue;
+        }
+        p->valuePublished(reported);
+        p->_lastPublished = now;
+        __atomic_add_fetch(&_published, 1, __ATOMIC_RELAXED);
+        if (rateLimit)
+            _budget -= 1000;
+    }
+
+    // Properties that arent due yet go first in the next batch, followed by the ones that became dirty meanwhile
+    lock();
+    _batch.resize(kept);
+    _batch.insert(_batch.end(), _dirty.begin(), _dirty.end());
+    _dirty.swap(_batch);
+    _batch.clear();
+    unlock();
+
+    if (nextDue == ULONG_MAX)
+        return portMAX_DELAY;
+    return pdMS_TO_TICKS(max(nextDue, 1UL));
+}
+
+void PublishScheduler::publishTaskCode(void *parameter) {
+    PublishScheduler *scheduler = (PublishScheduler *)parameter;
+    for (;;) {
+#ifdef TASK_VERBOSE_LOGGING
+        log_v("publishTaskCode Task running on Core %d name %s", xPortGetCoreID(), pcTaskGetTaskName(nullptr));
+#endif
+        TickType_t wait = scheduler->flush();
+        xSemaphoreTake(scheduler->_wake, wait);
+    }
+}
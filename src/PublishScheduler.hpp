@@ -0,0 +1,145 @@
+#pragma once
+
+#include <AsyncMqttClient.h>
+
+#include <vector>
+
+#ifndef CONFIG_HOMIE_PUBLISH_RUNNING_CORE
+#define CONFIG_HOMIE_PUBLISH_RUNNING_CORE -1
+#endif
+
+// How often pending values are retried while the MQTT client is disconnected
+#ifndef HOMIE_PUBLISH_RETRY_MS
+#define HOMIE_PUBLISH_RETRY_MS 500
+#endif
+
+class Property;
+
+/**
+ * @brief Publishes property values to their data topics on behalf of the Device.
+ *
+ * Without limits every value is published the moment it is set, like before.
+ * While the device is offline, or restoring after a reconnect, values wait in
+ * the batch instead, they are published once the device is ready again.
+ * Once a property has a minimum publish interval or the device has a publish
+ * rate limit, setValue() only marks the property dirty. A low priority task
+ * flushes the dirty properties in batches with whatever value they hold at
+ * that time, so a property set 100 times between two flushes is published once.
+ *
+ * The lock only guards the list of dirty properties, their values are guarded
+ * per property. The task copies a value before handing it to the MQTT client.
+ * A property that is already dirty is coalesced without taking the lock.
+ */
+class PublishScheduler {
+   private:
+    AsyncMqttClient &_client;
+
+    SemaphoreHandle_t _lock;
+    SemaphoreHandle_t _wake;
+    TaskHandle_t _task;
+
+    // Properties waiting to be published, _batch is what the task currently works off
+    std::vector<Property *> _dirty;
+    std::vector<Property *> _batch;
+    std::vector<char> _payload;
+
+    // Set while the device is offline or restoring, values are only marked dirty then
+    volatile bool _held = false;
+
+    uint16_t _rateLimit = 0;
+    // Publishes left in the current second, in 1/1000 publishes so refilling per ms stays exact
+    uint32_t _budget = 0;
+    unsigned long _lastRefill = 0;
+
+    // Counted by every task that sets values
+    uint32_t _published = 0;
+    uint32_t _coalesced = 0;
+    uint32_t _suppressed = 0;
+
+    // Values up to this length are copied to the stack by a direct publish, longer ones to the heap
+    static const size_t INLINE_VALUE_LEN = 32;
+
+    static void publishTaskCode(void *parameter);
+
+    /**
+     * @brief Publishes the dirty properties that are due and the rate limit allows.
+     *
+     * @return TickType_t how long the task can sleep until the next property is due
+     */
+    TickType_t flush();
+
+    void refillBudget(unsigned long now);
+
+    // Adds the property to the dirty list unless it is pending already, returns false if it was
+    bool markDirty(Property &property);
+
+   public:
+    PublishScheduler(AsyncMqttClient &client);
+
+    /**
+     * @brief Makes room for all properties of the device, so marking them dirty never allocates.
+     */
+    void reserve(size_t properties);
+
+    void lock();
+
+    void unlock();
+
+    /**
+     * @brief Publishes the current value of the property right away,
+     * or marks it dirty if it has a publish interval, a rate limit is set or publishing is held.
+     * A value the client doesn't take stays dirty until it does.
+     */
+    void publish(Property &property);
+
+    /**
+     * @brief Holds the values back while the device is offline or restoring, they are only marked dirty.
+     */
+    void hold();
+
+    /**
+     * @brief Publishes the values that were held back and the ones that failed, and publishes right away from now on.
+     */
+    void release();
+
+    /**
+     * @brief Set the global publish rate limit for property values
+     *
+     * @param publishesPerSecond 0 disables the limit
+     */
+    void setRateLimit(uint16_t publishesPerSecond);
+
+    uint16_t getRateLimit() {
+        return _rateLimit;
+    }
+
+    /**
+     * @brief Number of property values sent to the MQTT client.
+     */
+    uint32_t getPublishedCount() {
+        return __atomic_load_n(&_published, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Number of values that replaced a value which wasnt published yet.
+     */
+    uint32_t getCoalescedCount() {
+        return __atomic_load_n(&_coalesced, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Counts a value that wasnt published because it didnt change.
+     */
+    void countSuppressed() {
+        __atomic_add_fetch(&_suppressed, 1, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * @brief Number of values that werent published because they were equal to the last published value.
+     */
+    uint32_t getSuppressedCount() {
+        return __atomic_load_n(&_suppressed, __ATOMIC_RELAXED);
+    }
+
+    size_t getPendingCount();
+};
@@ -3,12 +3,13 @@
 #include <Stats.hpp>
 
 Stats::Stats(Device &src, AsyncMqttClient &client, const char *statName) : _parent(src),
-                                                                           _name(statName),
-                                                                           _id(statName),
-                                                                           _value(nullptr),
                                                                            _client(client),
                                                                            _func(nullptr) {
-    char *topic = new char[strlen(_parent.getTopic()) + 7 + strlen(_id) + 1];
+    _id = src.getArena().intern(statName);
+    _name = _id;
+    _value[0] = '\0';
+
+    char *topic = (char *)src.getArena().allocate(strlen(_parent.getTopic()) + 7 + strlen(_id) + 1, 1);
     stpcpy(topic, src.getTopic());
     strcat(topic, "$stats/");
     strcat(topic, _id);
@@ -16,10 +17,20 @@ Stats::Stats(Device &src, AsyncMqttClient &client, const char *statName) : _pare
     _topic = topic;
 }
 
+void Stats::setValue(const char *value) {
+    size_t len = strlen(value);
+    if (len > HOMIE_STATS_VALUE_LEN) {
+        log_w("Stats %s value is longer than HOMIE_STATS_VALUE_LEN (%d), it is cut off", _id, HOMIE_STATS_VALUE_LEN);
+        len = HOMIE_STATS_VALUE_LEN;
+    }
+    memcpy(_value, value, len);
+    _value[len] = '\0';
+}
+
 void Stats::publish() {
     _func(*this);
 #ifdef TASK_VERBOSE_LOGGING
     log_v("Stats %s topic: %s value %s", _name, _topic, _value);
 #endif
-    _client.publish(_topic, 1, true, _value);
+    _client.publish(_topic, _qos, _retained, _value);
 }
\ No newline at end of file
@@ -1,11 +1,17 @@
 #pragma once
 
+#undef TAG
 #define TAG "Home_Stats"
 
 #include <AsyncMqttClient.h>
 
 #include <HomieDatatype.hpp>
 
+// Longest value a stat publishes, longer values are cut off
+#ifndef HOMIE_STATS_VALUE_LEN
+#define HOMIE_STATS_VALUE_LEN 31
+#endif
+
 class Device;
 class Stats;
 
@@ -19,7 +25,10 @@ class Stats {
     const char *_name;
     const char *_id;
 
-    const char *_value;
+    // Set on every publish, so it is kept inline instead of being allocated
+    char _value[HOMIE_STATS_VALUE_LEN + 1];
+    uint8_t _qos = 1;
+    bool _retained = true;
     AsyncMqttClient &_client;
     GetStatsFunction _func;
 
@@ -33,24 +42,37 @@ class Stats {
         return _id;
     }
 
+    /**
+     * @brief QoS the value is published with, 0 saves the PUBACK for stats that are sent often anyway.
+     */
+    void setQos(uint8_t qos) {
+        this->_qos = qos > 2 ? 2 : qos;
+    }
+
+    uint8_t getQos() {
+        return _qos;
+    }
+
+    void setRetained(bool retained) {
+        this->_retained = retained;
+    }
+
+    bool isRetained() {
+        return _retained;
+    }
+
     void setFunc(GetStatsFunction func) {
         this->_func = func;
     }
 
-    void setValue(const char *value) {
-        if (_value)
-            delete[] _value;
-        char *valueBuff = new char[strlen(value) + 1];
-        strcpy(valueBuff, value);
-        this->_value = valueBuff;
-    }
+    void setValue(const char *value);
 
     void setValue(String value) {
         setValue(value.c_str());
     }
 
     void setValue(int value) {
-        setValue(String(value).c_str());
+        snprintf(this->_value, sizeof(this->_value), "%d", value);
     }
 
     const char *getValue() {
@@ -0,0 +1,34 @@
+#include <TopicBuilder.hpp>
+
+TopicBuilder::TopicBuilder(size_t size, const char *base) : _buff(_inline), _size(sizeof(_inline)) {
+    _buff[0] = '\0';
+    reserve(size);
+    appendToBase(base);
+}
+
+void TopicBuilder::reserve(size_t len) {
+    if (len + 1 <= _size)
+        return;
+
+    char *buff = new char[len + 1];
+    memcpy(buff, _buff, _baseLen);
+    if (_buff != _inline)
+        delete[] _buff;
+    _buff = buff;
+    _size = len + 1;
+}
+
+TopicBuilder &TopicBuilder::appendToBase(const char *d) {
+    size_t len = strlen(d);
+    reserve(_baseLen + len);
+    memcpy(_buff + _baseLen, d, len + 1);
+    _baseLen += len;
+    return *this;
+}
+
+const char *TopicBuilder::with(const char *suffix) {
+    size_t len = strlen(suffix);
+    reserve(_baseLen + len);
+    memcpy(_buff + _baseLen, suffix, len + 1);
+    return _buff;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#include <MessagePool.hpp>
+
+/**
+ * @brief Composes topics that share a common base, e.g. the attributes of a property.
+ * Every builder owns its buffer, so tasks composing topics at the same time dont
+ * get in each others way. Topics up to HOMIE_MAX_TOPIC_LEN are built in place, only a
+ * longer topic of the device (Device::getMaxTopicLength()) is built in a heap buffer.
+ *
+ * TopicBuilder topic(device.getMaxTopicLength(), property.getTopic(buff));
+ * client.publish(topic.with("/$name"), 1, true, name);
+ */
+class TopicBuilder {
+   private:
+    char *_buff;
+    size_t _size;
+    char _inline[HOMIE_MAX_TOPIC_LEN + 1];
+    size_t _baseLen = 0;
+
+    void reserve(size_t len);
+
+   public:
+    /**
+     * @param size length of the longest topic that will be built
+     * @param base the part all built topics start with
+     */
+    TopicBuilder(size_t size, const char *base);
+
+    TopicBuilder(const TopicBuilder &) = delete;
+    TopicBuilder &operator=(const TopicBuilder &) = delete;
+
+    ~TopicBuilder() {
+        if (_buff != _inline)
+            delete[] _buff;
+    }
+
+    /**
+     * @brief Appends d to the base, the following topics start with it as well.
+     */
+    TopicBuilder &appendToBase(const char *d);
+
+    /**
+     * @brief Builds base + suffix.
+     *
+     * @return const char* valid until the next call on this builder
+     */
+    const char *with(const char *suffix);
+};
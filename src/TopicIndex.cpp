@@ -0,0 +1,205 @@
+#include <algorithm>
+
+#include <Node.hpp>
+#include <Property.hpp>
+#include <TopicIndex.hpp>
+
+TopicIndex::Segment TopicIndex::makeSegment(const char *id, char terminator) {
+    // FNV-1a, computed while scanning for the end of the segment
+    uint32_t hash = 2166136261u;
+    const char *crnt = id;
+    while (*crnt && *crnt != terminator) {
+        hash = (hash ^ (uint8_t)*crnt) * 16777619u;
+        crnt++;
+    }
+    return {id, (size_t)(crnt - id), hash};
+}
+
+bool TopicIndex::segmentLess(const Segment &a, const Segment &b) {
+    // Ordered by hash first, most lookups are decided by a single integer compare
+    if (a.hash != b.hash)
+        return a.hash < b.hash;
+    if (a.len != b.len)
+        return a.len < b.len;
+    return memcmp(a.id, b.id, a.len) < 0;
+}
+
+bool TopicIndex::build(const char *deviceTopic, const std::vector<Node *> &nodes, ModelArena &arena) {
+    if (_frozen)
+        return false;
+
+    size_t count = 0;
+    for (auto const &node : nodes)
+        count += node->getProperties().size();
+    if (count > HOMIE_MAX_PROPERTIES || nodes.size() > UINT16_MAX) {
+        log_e("The device has %d properties, at most %d are supported", count, HOMIE_MAX_PROPERTIES);
+        return false;
+    }
+
+    _prefix = deviceTopic;
+    _prefixLen = strlen(deviceTopic);
+
+    _nodeCount = nodes.size();
+    _count = count;
+    _nodes = arena.allocateArray<NodeEntry>(_nodeCount);
+    _entries = arena.allocateArray<PropertyEntry>(_count);
+    _properties = arena.allocateArray<Property *>(_count);
+    _registered = arena.allocateArray<uint8_t>(_count);
+
+    uint16_t index = 0;
+    for (uint16_t n = 0; n < _nodeCount; n++) {
+        Node *node = nodes[n];
+        NodeEntry &nodeEntry = _nodes[n];
+        nodeEntry.segment = makeSegment(node->getId(), '\0');
+        nodeEntry.first = index;
+        nodeEntry.count = node->getProperties().size();
+
+        for (auto const &prop : node->getProperties()) {
+            prop->_index = index;
+            _properties[index] = prop;
+            _entries[index] = {makeSegment(prop->getId(), '\0'), index};
+            index++;
+        }
+        std::sort(_entries + nodeEntry.first, _entries + index,
+                  [](const PropertyEntry &a, const PropertyEntry &b) { return segmentLess(a.segment, b.segment); });
+        _hashed |= nodeEntry.count > HOMIE_TOPIC_SCAN_MAX;
+    }
+    _hashed |= _nodeCount > HOMIE_TOPIC_SCAN_MAX;
+    std::sort(_nodes, _nodes + _nodeCount,
+              [](const NodeEntry &a, const NodeEntry &b) { return segmentLess(a.segment, b.segment); });
+
+    _frozen = true;
+    return true;
+}
+
+TopicIndex::NodeEntry *TopicIndex::findNode(const Segment &nodeSeg) {
+    NodeEntry *end = _nodes + _nodeCount;
+    NodeEntry *node = std::lower_bound(_nodes, end, nodeSeg,
+                                       [](const NodeEntry &a, const Segment &b) { return segmentLess(a.segment, b); });
+    if (node == end || segmentLess(nodeSeg, node->segment))
+        return nullptr;
+    return node;
+}
+
+TopicIndex::PropertyEntry *TopicIndex::findEntry(const Segment &nodeSeg, const Segment &propSeg) {
+    NodeEntry *node = findNode(nodeSeg);
+    if (!node)
+        return nullptr;
+
+    PropertyEntry *first = _entries + node->first;
+    PropertyEntry *end = first + node->count;
+    PropertyEntry *entry = std::lower_bound(first, end, propSeg,
+                                            [](const PropertyEntry &a, const Segment &b) { return segmentLess(a.segment, b); });
+    if (entry == end || segmentLess(propSeg, entry->segment))
+        return nullptr;
+
+    return entry;
+}
+
+TopicIndex::PropertyEntry *TopicIndex::scanEntry(const char *path, TopicChannel &channel) {
+    size_t len = strlen(path);
+    for (NodeEntry *node = _nodes; node != _nodes + _nodeCount; node++) {
+        size_t nodeLen = node->segment.len;
+        if (len <= nodeLen || path[nodeLen] != '/' || !segmentAt(path, node->segment))
+            continue;
+
+        // Node ids are unique, the property is in this node or nowhere
+        const char *prop = path + nodeLen + 1;
+        size_t propLen = len - nodeLen - 1;
+        PropertyEntry *end = _entries + node->first + node->count;
+        for (PropertyEntry *entry = _entries + node->first; entry != end; entry++) {
+            size_t idLen = entry->segment.len;
+            if (propLen != idLen && (propLen != idLen + 4 || memcmp(prop + idLen, "/set", 4) != 0))
+                continue;
+            if (segmentAt(prop, entry->segment)) {
+                channel = propLen == idLen ? TOPIC_DATA : TOPIC_SET;
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+    return nullptr;
+}
+
+uint16_t TopicIndex::indexOf(Property &property) {
+    uint16_t index = property.getIndex();
+    return index < _count && _properties[index] == &property ? index : _count;
+}
+
+bool TopicIndex::add(Property &property, TopicChannel channel) {
+    uint16_t index = indexOf(property);
+    if (index == _count)
+        return false;
+
+    setRegistered(index, channel, true);
+    return true;
+}
+
+size_t TopicIndex::addNode(Node &node) {
+    NodeEntry *nodeEntry = findNode(makeSegment(node.getId(), '\0'));
+    if (!nodeEntry)
+        return 0;
+
+    size_t count = 0;
+    for (uint16_t i = nodeEntry->first; i < nodeEntry->first + nodeEntry->count; i++) {
+        Property *p = _properties[i];
+        if (!p->isSettable())
+            continue;
+
+        setRegistered(i, TOPIC_SET, true);
+        if (p->isRetained())
+            setRegistered(i, TOPIC_DATA, true);
+        count++;
+    }
+    return count;
+}
+
+void TopicIndex::remove(Property &property, TopicChannel channel) {
+    uint16_t index = indexOf(property);
+    if (index != _count)
+        setRegistered(index, channel, false);
+}
+
+bool TopicIndex::has(Property &property, TopicChannel channel) {
+    uint16_t index = indexOf(property);
+    return index != _count && isRegistered(index, channel);
+}
+
+Property *TopicIndex::find(const char *topic, TopicChannel *channel) {
+    if (!_frozen || strncmp(topic, _prefix, _prefixLen) != 0)
+        return nullptr;
+
+    TopicChannel ch;
+    if (!_hashed) {
+        PropertyEntry *entry = scanEntry(topic + _prefixLen, ch);
+        if (!entry || !isRegistered(entry->index, ch))
+            return nullptr;
+        if (channel)
+            *channel = ch;
+        return _properties[entry->index];
+    }
+
+    // <node>/<property>[/set]
+    Segment nodeSeg = makeSegment(topic + _prefixLen, '/');
+    const char *end = nodeSeg.id + nodeSeg.len;
+    if (*end != '/')
+        return nullptr;
+
+    Segment propSeg = makeSegment(end + 1, '/');
+    end = propSeg.id + propSeg.len;
+
+    if (*end == '\0')
+        ch = TOPIC_DATA;
+    else if (strcmp(end, "/set") == 0)
+        ch = TOPIC_SET;
+    else
+        return nullptr;
+
+    PropertyEntry *entry = findEntry(nodeSeg, propSeg);
+    if (!entry || !isRegistered(entry->index, ch))
+        return nullptr;
+
+    if (channel)
+        *channel = ch;
+    return _properties[entry->index];
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include <ModelArena.hpp>
+
+class Node;
+class Property;
+
+// The property indices are 16 bit
+#define HOMIE_MAX_PROPERTIES (UINT16_MAX - 1)
+
+// Up to this many nodes, and properties per node, the tables are scanned instead of hashed and searched
+#ifndef HOMIE_TOPIC_SCAN_MAX
+#define HOMIE_TOPIC_SCAN_MAX 16
+#endif
+
+typedef enum {
+    TOPIC_DATA = 0,  // homie/device/node/property
+    TOPIC_SET = 1    // homie/device/node/property/set
+} TopicChannel;
+
+/**
+ * @brief Maps incoming property topics to their Property.
+ * The index is built once from the device model and is frozen afterwards,
+ * only the registered state of the DATA/SET channels changes later on.
+ * Building it gives every property a dense index (Property::getIndex()), in the
+ * order the nodes and properties were added. All tables are flat arrays in the
+ * model arena, the per property state is looked up by that index in O(1).
+ * A lookup compares the shared "homie/<id>/" prefix once, hashes the node and
+ * property segments in a single pass and resolves them with a binary search
+ * over tables sorted by that hash. Up to HOMIE_TOPIC_SCAN_MAX nodes and
+ * properties per node the tables are scanned instead, comparing the ids with
+ * the topic right away is faster than hashing it.
+ * Since the tables never change after the build and the registered flags are
+ * read and written atomically, lookups from the incoming task are safe while
+ * channels get (un)registered.
+ */
+class TopicIndex {
+   private:
+    struct Segment {
+        const char *id;
+        size_t len;
+        uint32_t hash;
+    };
+
+    struct PropertyEntry {
+        Segment segment;
+        uint16_t index;
+    };
+
+    // The properties of a node are entries[first] .. entries[first + count - 1], sorted by segment
+    struct NodeEntry {
+        Segment segment;
+        uint16_t first;
+        uint16_t count;
+    };
+
+    const char *_prefix = nullptr;
+    size_t _prefixLen = 0;
+    bool _frozen = false;
+    // Set if a table is too large to be scanned
+    bool _hashed = false;
+    NodeEntry *_nodes = nullptr;
+    uint16_t _nodeCount = 0;
+    PropertyEntry *_entries = nullptr;
+    // Indexed by Property::getIndex()
+    Property **_properties = nullptr;
+    // Bit 1 << TopicChannel per property, written by the init task while the incoming task reads them
+    uint8_t *_registered = nullptr;
+    uint16_t _count = 0;
+
+    static Segment makeSegment(const char *id, char terminator);
+    static bool segmentLess(const Segment &a, const Segment &b);
+
+    // Checks if str, which is at least as long, starts with the id of segment.
+    // Ids of a node tend to differ in their last char, e.g. channel1 and channel2, so it goes first.
+    static bool segmentAt(const char *str, const Segment &segment) {
+        if (segment.len == 0)
+            return true;
+        size_t last = segment.len - 1;
+        return str[last] == segment.id[last] && memcmp(str, segment.id, last) == 0;
+    }
+
+    NodeEntry *findNode(const Segment &nodeSeg);
+    PropertyEntry *findEntry(const Segment &nodeSeg, const Segment &propSeg);
+    // Resolves <node>/<property>[/set] by scanning the tables
+    PropertyEntry *scanEntry(const char *path, TopicChannel &channel);
+
+    bool isRegistered(uint16_t index, TopicChannel channel) {
+        return __atomic_load_n(&_registered[index], __ATOMIC_ACQUIRE) & (1 << channel);
+    }
+
+    void setRegistered(uint16_t index, TopicChannel channel, bool registered) {
+        if (registered)
+            __atomic_fetch_or(&_registered[index], (uint8_t)(1 << channel), __ATOMIC_ACQ_REL);
+        else
+            __atomic_fetch_and(&_registered[index], (uint8_t) ~(1 << channel), __ATOMIC_ACQ_REL);
+    }
+
+    // Index of a property of this index, _count if it isnt part of it
+    uint16_t indexOf(Property &property);
+
+   public:
+    /**
+     * @brief Builds the index for the given nodes and assigns the property indices, can only be done once.
+     *
+     * @param deviceTopic the base topic of the device e.g. "homie/lamp-v2-dev/"
+     * @param nodes the nodes of the device
+     * @param arena the tables are allocated from
+     * @return false if the index was already frozen or there are more than HOMIE_MAX_PROPERTIES properties
+     */
+    bool build(const char *deviceTopic, const std::vector<Node *> &nodes, ModelArena &arena);
+
+    bool isFrozen() {
+        return _frozen;
+    }
+
+    /**
+     * @brief Number of indexed properties, the indices are 0 .. size() - 1.
+     */
+    uint16_t size() {
+        return _count;
+    }
+
+    /**
+     * @brief The Property with the given index, nullptr if there is none.
+     */
+    Property *get(uint16_t index) {
+        return index < _count ? _properties[index] : nullptr;
+    }
+
+    /**
+     * @brief Marks the given channel of a Property as registered, so find() resolves it.
+     *
+     * @return false if the property isnt part of the index
+     */
+    bool add(Property &property, TopicChannel channel);
+
+    /**
+     * @brief Registers all properties of a node in one pass, the SET channel of
+     * settable properties and also the DATA channel if they are retained.
+     *
+     * @return size_t the number of registered properties
+     */
+    size_t addNode(Node &node);
+
+    /**
+     * @brief Unregisters the given channel of a Property.
+     */
+    void remove(Property &property, TopicChannel channel);
+
+    /**
+     * @brief Checks if the given channel of a Property is registered.
+     */
+    bool has(Property &property, TopicChannel channel);
+
+    /**
+     * @brief Resolves a full topic to a registered Property.
+     *
+     * @param topic e.g. "homie/lamp-v2-dev/lamp/brightness/set"
+     * @param channel optional, receives the channel the topic belongs to
+     * @return Property* or nullptr if the topic isnt registered
+     */
+    Property *find(const char *topic, TopicChannel *channel = nullptr);
+
+    /**
+     * @brief Calls func(Property &) for every Property with a registered channel, in index order.
+     * func may unregister the channel it was called for.
+     */
+    template <typename F>
+    void forEach(TopicChannel channel, F func) {
+        for (uint16_t i = 0; i < _count; i++) {
+            if (isRegistered(i, channel))
+                func(*_properties[i]);
+        }
+    }
+};
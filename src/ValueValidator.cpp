@@ -0,0 +1,254 @@
+#include <ValueValidator.hpp>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Powers of ten that are exact as double
+static const double exactPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Parses an optionally signed decimal integer, returns the position after it or nullptr
+static const char *parseInt(const char *s, int64_t &out) {
+    bool negative = *s == '-';
+    if (*s == '-' || *s == '+')
+        s++;
+    if (!isDigit(*s))
+        return nullptr;
+
+    const uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t value = 0;
+    for (; isDigit(*s); s++) {
+        unsigned digit = *s - '0';
+        if (value > (limit - digit) / 10)
+            return nullptr;
+        value = value * 10 + digit;
+    }
+    out = negative ? (int64_t)(0 - value) : (int64_t)value;
+    return s;
+}
+
+// Parses a decimal number with optional fraction and exponent, returns the position after it or nullptr
+static const char *parseFloat(const char *s, double &out) {
+    const char *start = s;
+    bool negative = *s == '-';
+    if (*s == '-' || *s == '+')
+        s++;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; isDigit(*s); s++) {
+        any = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            if (mantissa)
+                digits++;
+        } else {
+            exponent++;
+        }
+    }
+    if (*s == '.') {
+        for (s++; isDigit(*s); s++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                if (mantissa)
+                    digits++;
+                exponent--;
+            }
+        }
+    }
+    if (!any)
+        return nullptr;
+
+    if (*s == 'e' || *s == 'E') {
+        int64_t e;
+        const char *end = parseInt(s + 1, e);
+        if (!end)
+            return nullptr;
+        exponent += e < -1000 ? -1000 : e > 1000 ? 1000 : (int)e;
+        s = end;
+    }
+
+    double value;
+    if (mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        // Both operands are exact, so the result is rounded correctly
+        value = exponent < 0 ? mantissa / exactPow10[-exponent] : mantissa * exactPow10[exponent];
+        out = negative ? -value : value;
+    } else {
+        // Too many digits for the fast path, rare enough to leave to the C library
+        out = strtod(start, nullptr);
+    }
+    return isinf(out) ? nullptr : s;
+}
+
+bool ValueValidator::compile(HomieDataType dataType, const char *format) {
+    _dataType = dataType;
+    _hasMin = _hasMax = _hasStep = false;
+    _colorSpace = COLOR_UNKNOWN;
+
+    if (!format || *format == '\0')
+        return dataType != HOMIE_COLOR;
+
+    if (dataType == HOMIE_COLOR) {
+        _colorSpace = ColorCodec::spaceOf(format);
+        return _colorSpace != COLOR_UNKNOWN;
+    }
+
+    if (dataType != HOMIE_INT && dataType != HOMIE_FLOAT)
+        return true;
+
+    // min:max:step, every part is optional
+    bool has[3] = {false, false, false};
+    int64_t ints[3];
+    double floats[3];
+    const char *pos = format;
+    for (int part = 0; part < 3; part++) {
+        if (*pos != ':' && *pos != '\0') {
+            const char *end = dataType == HOMIE_INT ? parseInt(pos, ints[part]) : parseFloat(pos, floats[part]);
+            if (!end || (*end != ':' && *end != '\0'))
+                return false;
+            has[part] = true;
+            pos = end;
+        }
+        if (*pos == '\0')
+            break;
+        if (part == 2)
+            return false;
+        pos++;
+    }
+
+    if (dataType == HOMIE_INT) {
+        if ((has[0] && has[1] && ints[0] > ints[1]) || (has[2] && ints[2] <= 0))
+            return false;
+        _intMin = ints[0];
+        _intMax = ints[1];
+        _intStep = ints[2];
+    } else {
+        if ((has[0] && has[1] && floats[0] > floats[1]) || (has[2] && floats[2] <= 0))
+            return false;
+        _floatMin = floats[0];
+        _floatMax = floats[1];
+        _floatStep = floats[2];
+    }
+    _hasMin = has[0];
+    _hasMax = has[1];
+    _hasStep = has[2];
+    return true;
+}
+
+ValidationResult ValueValidator::check(const char *value, HomieValue &native) const {
+    switch (_dataType) {
+        case HOMIE_INT: {
+            const char *end = parseInt(value, native.intValue);
+            if (!end || *end != '\0')
+                return VALUE_INVALID;
+            return checkInt(native);
+        }
+        case HOMIE_FLOAT: {
+            const char *end = parseFloat(value, native.floatValue);
+            if (!end || *end != '\0')
+                return VALUE_INVALID;
+            return checkFloat(native);
+        }
+        case HOMIE_BOOL:
+            if (strcmp(value, "true") == 0) {
+                native.boolValue = true;
+            } else if (strcmp(value, "false") == 0) {
+                native.boolValue = false;
+            } else {
+                return VALUE_INVALID;
+            }
+            return VALUE_VALID;
+        case HOMIE_COLOR:
+            if (!ColorCodec::parse(value, native.colorValue))
+                return VALUE_INVALID;
+            return checkColor(native);
+        default:
+            return VALUE_VALID;
+    }
+}
+
+ValidationResult ValueValidator::check(HomieValue &native) const {
+    switch (_dataType) {
+        case HOMIE_INT:
+            return checkInt(native);
+        case HOMIE_FLOAT:
+            return isinf(native.floatValue) || isnan(native.floatValue) ? VALUE_INVALID : checkFloat(native);
+        case HOMIE_COLOR:
+            return checkColor(native);
+        default:
+            return VALUE_VALID;
+    }
+}
+
+ValidationResult ValueValidator::checkInt(HomieValue &native) const {
+    int64_t value = native.intValue;
+    if (_hasMin && value < _intMin)
+        value = _intMin;
+    if (_hasMax && value > _intMax)
+        value = _intMax;
+    if (_hasStep) {
+        int64_t base = _hasMin ? _intMin : 0;
+        int64_t offset = (value - base) % _intStep;
+        if (offset < 0)
+            offset += _intStep;
+        if (offset) {
+            // Nearest step that is still in the range
+            int64_t down = value - offset;
+            value = offset * 2 >= _intStep ? down + _intStep : down;
+            if (_hasMax && value > _intMax)
+                value = down;
+        }
+    }
+
+    if (value == native.intValue)
+        return VALUE_VALID;
+    if (!_clamp)
+        return VALUE_INVALID;
+    native.intValue = value;
+    return VALUE_CLAMPED;
+}
+
+ValidationResult ValueValidator::checkFloat(HomieValue &native) const {
+    double value = native.floatValue;
+    if (_hasMin && value < _floatMin)
+        value = _floatMin;
+    if (_hasMax && value > _floatMax)
+        value = _floatMax;
+    if (_hasStep) {
+        double base = _hasMin ? _floatMin : 0;
+        double steps = floor((value - base) / _floatStep + 0.5);
+        double snapped = base + steps * _floatStep;
+        if (_hasMax && snapped > _floatMax)
+            snapped -= _floatStep;
+        // Payloads are decimal, allow for the rounding of the step in binary
+        if (fabs(snapped - value) > _floatStep * 1e-9)
+            value = snapped;
+    }
+
+    if (value == native.floatValue)
+        return VALUE_VALID;
+    if (!_clamp)
+        return VALUE_INVALID;
+    native.floatValue = value;
+    return VALUE_CLAMPED;
+}
+
+ValidationResult ValueValidator::checkColor(HomieValue &native) const {
+    if (_colorSpace == COLOR_UNKNOWN)
+        return VALUE_INVALID;
+
+    HomieColor color = native.colorValue;
+    if (ColorCodec::clamp(color, _colorSpace))
+        return VALUE_VALID;
+    if (!_clamp)
+        return VALUE_INVALID;
+    native.colorValue = color;
+    return VALUE_CLAMPED;
+}
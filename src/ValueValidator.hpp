@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <ColorCodec.hpp>
+#include <HomieDatatype.hpp>
+
+typedef enum {
+    VALUE_INVALID,
+    VALUE_VALID,
+    // Out of the format, but clamp is set and the native value was corrected
+    VALUE_CLAMPED,
+} ValidationResult;
+
+/**
+ * @brief Checks values against the $format of a property.
+ * The format is compiled once into limits, checking a payload parses it in a
+ * single pass into its native value. Neither compiling nor checking allocates
+ * or uses printf/scanf.
+ *
+ * Integer and float formats are "min:max" with an optional ":step", either
+ * limit may be left empty. Color formats are "hsv" or "rgb". Enum values are
+ * matched by the Property itself.
+ */
+class ValueValidator {
+   private:
+    HomieDataType _dataType = HOMIE_UNDEFINED;
+    bool _clamp = false;
+
+    bool _hasMin = false;
+    bool _hasMax = false;
+    bool _hasStep = false;
+    // Limits of integer properties are kept as integers, so large values dont lose precision
+    int64_t _intMin, _intMax, _intStep;
+    double _floatMin, _floatMax, _floatStep;
+
+    HomieColorSpace _colorSpace = COLOR_UNKNOWN;
+
+    ValidationResult checkInt(HomieValue &native) const;
+    ValidationResult checkFloat(HomieValue &native) const;
+    ValidationResult checkColor(HomieValue &native) const;
+
+   public:
+    /**
+     * @brief Compiles the format, a missing format only checks the data type.
+     *
+     * @return false if the format couldnt be parsed, the value is then only checked against the data type
+     */
+    bool compile(HomieDataType dataType, const char *format);
+
+    /**
+     * @brief Values outside of the range or between two steps are corrected to the nearest allowed value instead of being rejected.
+     */
+    void setClamp(bool clamp) {
+        this->_clamp = clamp;
+    }
+
+    bool isClamp() {
+        return this->_clamp;
+    }
+
+    HomieColorSpace getColorSpace() {
+        return this->_colorSpace;
+    }
+
+    /**
+     * @brief Parses value and checks it against the format.
+     *
+     * @param native receives the parsed value, unless VALUE_INVALID is returned
+     */
+    ValidationResult check(const char *value, HomieValue &native) const;
+
+    /**
+     * @brief Checks a value set through a typed setter.
+     */
+    ValidationResult check(HomieValue &native) const;
+};